@@ -28,10 +28,13 @@ void PluginBase::commonInitialize(unique_ptr<QSettings> &s)
     restore_split_camel_case(s);
     restore_use_acronyms(s);
 
-    for (auto f : { &PluginBase::use_non_localized_name_changed,
-                    &PluginBase::split_camel_case_changed,
+    connect(this, &PluginBase::use_non_localized_name_changed,
+            this, &PluginBase::updateIndexItems);
+
+    // The index items of all applications change
+    for (auto f : { &PluginBase::split_camel_case_changed,
                     &PluginBase::use_acronyms_changed })
-        connect(this, f, this, &PluginBase::updateIndexItems);
+        connect(this, f, this, [this]{ index_items.clear(); updateIndexItems(); });
 }
 
 void PluginBase::setUserTerminalFromConfig()
@@ -135,16 +138,26 @@ void PluginBase::addBaseConfig(QFormLayout *l)
     l->addRow(tr("Terminal"), createTerminalFormWidget());
 }
 
-vector<IndexItem> PluginBase::buildIndexItems() const
+vector<IndexItem> PluginBase::buildIndexItems()
 {
     vector<IndexItem> r;
+    decltype(index_items) items;
 
     for (const auto &iapp : applications)
     {
+        // Unchanged applications are the same objects, reuse their items
+        if (auto node = index_items.extract(iapp); !node.empty())
+        {
+            const auto &app_items = items.insert(::move(node)).position->second;
+            r.insert(r.end(), app_items.begin(), app_items.end());
+            continue;
+        }
+
+        auto &app_items = items[iapp];
         auto app = static_pointer_cast<Application>(iapp);
         for (const auto &name : app->names())
         {
-            r.emplace_back(app, name);
+            app_items.emplace_back(app, name);
 
             // https://en.wikipedia.org/wiki/Combining_Diacritical_Marks
             static QRegularExpression re(R"([\x{0300}-\x{036f}])");
@@ -153,7 +166,7 @@ vector<IndexItem> PluginBase::buildIndexItems() const
             auto ccs = camelCaseSplit(normalized);
 
             if (split_camel_case_)
-                r.emplace_back(app, ccs.join(QChar::Space));
+                app_items.emplace_back(app, ccs.join(QChar::Space));
 
             if (use_acronyms_)
             {
@@ -163,11 +176,13 @@ vector<IndexItem> PluginBase::buildIndexItems() const
                         acronym.append(w[0]);
 
                 if (acronym.size() > 1)
-                    r.emplace_back(app, acronym);
+                    app_items.emplace_back(app, acronym);
             }
         }
+        r.insert(r.end(), app_items.begin(), app_items.end());
     }
 
+    index_items = ::move(items);  // drops the items of removed applications
     return r;
 }
 
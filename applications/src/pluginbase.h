@@ -8,6 +8,7 @@
 #include <albert/extensionplugin.h>
 #include <albert/indexqueryhandler.h>
 #include <albert/property.h>
+#include <map>
 #include <memory>
 #include <vector>
 class Terminal;
@@ -35,7 +36,7 @@ protected:
     void setUserTerminalFromConfig();
     QWidget *createTerminalFormWidget();
     void addBaseConfig(QFormLayout*);
-    std::vector<albert::IndexItem> buildIndexItems() const;
+    std::vector<albert::IndexItem> buildIndexItems();
     static QStringList camelCaseSplit(const QString &s);
 
     QFileSystemWatcher fs_watcher;
@@ -44,6 +45,9 @@ protected:
     std::vector<Terminal*> terminals;
     Terminal* terminal = nullptr;
 
+    // Index items by application, kept for applications unchanged since the last build
+    std::map<std::shared_ptr<applications::Application>, std::vector<albert::IndexItem>> index_items;
+
     ALBERT_PLUGIN_PROPERTY(bool, use_non_localized_name, false)
     ALBERT_PLUGIN_PROPERTY(bool, split_camel_case, true)
     ALBERT_PLUGIN_PROPERTY(bool, use_acronyms, true)
@@ -3,6 +3,7 @@
 #include "application.h"
 #include "desktopentryparser.h"
 #include "plugin.h"
+#include <QDataStream>
 #include <albert/albert.h>
 using namespace std;
 using namespace albert;
@@ -15,63 +16,59 @@ Application::Application(const QString &id, const QString &path, ParseOptions po
     path_ = path;
 
     DesktopEntryParser p(path);
-    auto root_section = QStringLiteral("Desktop Entry");
+    const QByteArrayView root_section = "Desktop Entry";
 
     // Post a warning on unsupported terminals
-    try {
-        if (ranges::any_of(p.getString(root_section, QStringLiteral("Categories")).split(';', Qt::SkipEmptyParts),
+    if (const auto categories = p.getString(root_section, "Categories"); categories)
+        if (ranges::any_of(categories->split(';', Qt::SkipEmptyParts),
                            [&](const auto &cat){ return cat == QStringLiteral("TerminalEmulator"); }))
             is_terminal_ = true;
-    } catch (const out_of_range &) { }
 
     // Type - string, REQUIRED to be Application
-    if (p.getString(root_section, QStringLiteral("Type")) != QStringLiteral("Application"))
+    if (p.getString(root_section, "Type") != QStringLiteral("Application"))
         throw runtime_error("Desktop entries of type other than 'Application' are not handled yet.");
 
     // NoDisplay - boolean, must not be true
-    try {
-        if (p.getBoolean(root_section, QStringLiteral("NoDisplay")))
-            throw runtime_error("Desktop entry excluded by 'NoDisplay'.");
-    } catch (const out_of_range &) { }
+    if (p.getBoolean(root_section, "NoDisplay").value_or(false))
+        throw runtime_error("Desktop entry excluded by 'NoDisplay'.");
 
     if (!po.ignore_show_in_keys)
     {
         const auto desktops(QString(getenv("XDG_CURRENT_DESKTOP")).split(':', Qt::SkipEmptyParts));
 
         // NotShowIn - string(s), if exists must not be in XDG_CURRENT_DESKTOP
-        try {
-            if (ranges::any_of(p.getString(root_section, QStringLiteral("NotShowIn")).split(';', Qt::SkipEmptyParts),
+        if (const auto not_show_in = p.getString(root_section, "NotShowIn"); not_show_in)
+            if (ranges::any_of(not_show_in->split(';', Qt::SkipEmptyParts),
                                [&](const auto &de){ return desktops.contains(de); }))
                 throw runtime_error("Desktop entry excluded by 'NotShowIn'.");
-        } catch (const out_of_range &) { }
 
         // OnlyShowIn - string(s), if exists has to be in XDG_CURRENT_DESKTOP
-        try {
-            if (!ranges::any_of(p.getString(root_section, QStringLiteral("OnlyShowIn")).split(';', Qt::SkipEmptyParts),
+        if (const auto only_show_in = p.getString(root_section, "OnlyShowIn"); only_show_in)
+            if (!ranges::any_of(only_show_in->split(';', Qt::SkipEmptyParts),
                                 [&](const auto &de){ return desktops.contains(de); }))
                 throw runtime_error("Desktop entry excluded by 'OnlyShowIn'.");
-        } catch (const out_of_range &) { }
     }
 
+    // Non localized name - string, REQUIRED
+    const auto name = p.getString(root_section, "Name");
+    if (!name)
+        throw runtime_error("Desktop entry has no 'Name'.");
+
     // Localized name - localestring, may equal name if no localizations available
-    // No need to catch despite optional, since falls back to name, which is required
-    names_ << p.getLocaleString(root_section, QStringLiteral("Name"));
+    names_ << p.getLocaleString(root_section, "Name").value_or(*name);
 
-    // Non localized name - string, REQUIRED
     if (po.use_non_localized_name)
-        names_ << p.getString(root_section, QStringLiteral("Name"));
+        names_ << *name;
 
     // Exec - string, REQUIRED despite not strictly by standard
-    try
-    {
-        exec_ = DesktopEntryParser::splitExec(p.getString(root_section, QStringLiteral("Exec"))).value();
-        if (exec_.isEmpty())
-            throw runtime_error("Empty Exec value.");
-    }
-    catch (const bad_optional_access&)
-    {
+    if (auto exec = p.getString(root_section, "Exec"); !exec)
+        throw runtime_error("Desktop entry has no 'Exec'.");
+    else if (auto split = DesktopEntryParser::splitExec(*exec); !split)
         throw runtime_error("Malformed Exec value.");
-    }
+    else if (split->isEmpty())
+        throw runtime_error("Empty Exec value.");
+    else
+        exec_ = ::move(*split);
 
     if (po.use_exec)
     {
@@ -93,93 +90,94 @@ Application::Application(const QString &id, const QString &path, ParseOptions po
     }
 
     // Comment - localestring
-    try {
-        description_ = p.getLocaleString(root_section, QStringLiteral("Comment"));
-    } catch (const out_of_range &) { }
+    description_ = p.getLocaleString(root_section, "Comment").value_or(QString());
 
     // Keywords - localestring(s)
-    try {
-        auto keywords = p.getLocaleString(root_section, QStringLiteral("Keywords")).split(';', Qt::SkipEmptyParts);
+    if (const auto keywords_string = p.getLocaleString(root_section, "Keywords"); keywords_string)
+    {
+        auto keywords = keywords_string->split(';', Qt::SkipEmptyParts);
         if (description_.isEmpty())
             description_ = keywords.join(", ");
         if (po.use_keywords)
             names_ << keywords;
-    } catch (const out_of_range &) { }
+    }
 
     // Icon - iconstring (xdg icon naming spec)
-    try {
-        icon_ = p.getLocaleString(root_section, QStringLiteral("Icon"));
-    } catch (const out_of_range &) { }
+    icon_ = p.getLocaleString(root_section, "Icon").value_or(QString());
 
     // Path - string
-    try {
-        working_dir_ = p.getString(root_section, QStringLiteral("Path"));
-    } catch (const out_of_range &) { }
+    working_dir_ = p.getString(root_section, "Path").value_or(QString());
 
     // Terminal - boolean
-    try {
-        term_ = p.getBoolean(root_section, QStringLiteral("Terminal"));
-    } catch (const out_of_range &) { }
+    term_ = p.getBoolean(root_section, "Terminal").value_or(false);
 
     // GenericName - localestring
     if (po.use_generic_name)
-        try {
-            names_<< p.getLocaleString(root_section, QStringLiteral("GenericName"));
-        }
-        catch (const out_of_range &) { }
+        if (auto generic_name = p.getLocaleString(root_section, "GenericName"); generic_name)
+            names_ << ::move(*generic_name);
 
     // Actions - string(s)
-    try {
-        auto action_ids = p.getString(root_section, QStringLiteral("Actions")).split(';', Qt::SkipEmptyParts);
-        for (const QString &action_id : action_ids)
+    if (const auto actions = p.getString(root_section, "Actions"); actions)
+        for (const QString &action_id : actions->split(';', Qt::SkipEmptyParts))
         {
-            try
-            {
-                const auto action_section = QString("Desktop Action %1").arg(action_id);
-
-                // TOdo
-                auto action = Action(
-                    action_id,
-                    p.getLocaleString(action_section, QStringLiteral("Name")), // Name - localestring, REQUIRED
-                    [this, &p, &action_section]{
-                        auto exec = DesktopEntryParser::splitExec(p.getString(action_section, QStringLiteral("Exec")));
-                        if (!exec)
-                            throw runtime_error("Malformed Exec value.");
-                        else if (exec.value().isEmpty())
-                            throw runtime_error("Empty Exec value.");
-                        else
-                            runDetachedProcess(fieldCodesExpanded(exec.value(), QUrl()));
-                    }
-                );
-
-                // Name - localestring, REQUIRED
-                auto name = p.getLocaleString(action_section, QStringLiteral("Name"));
-
-                // Exec - string, REQUIRED despite not strictly by standard
-                auto exec = DesktopEntryParser::splitExec(p.getString(action_section, QStringLiteral("Exec")));
-                if (!exec)
-                    throw runtime_error("Malformed Exec value.");
-                else if (exec.value().isEmpty())
-                    throw runtime_error("Empty Exec value.");
-                else
-                    desktop_actions_.emplace_back(*this, action_id, name, exec.value());
-            }
-            catch (const out_of_range &e)
-            {
-                WARN << QString("%1: Desktop action '%2' skipped: %3").arg(path, action_id, e.what());
-            }
+            const auto action_section = QString("Desktop Action %1").arg(action_id).toUtf8();
+
+            // Name - localestring, REQUIRED
+            auto name = p.getLocaleString(action_section, "Name");
+
+            // Exec - string, REQUIRED despite not strictly by standard
+            auto exec = p.getString(action_section, "Exec");
+
+            if (!name || !exec)
+                WARN << QString("%1: Desktop action '%2' skipped: Missing Name or Exec.")
+                            .arg(path, action_id);
+            else if (auto split = DesktopEntryParser::splitExec(*exec); !split)
+                WARN << QString("%1: Desktop action '%2' skipped: Malformed Exec value.")
+                            .arg(path, action_id);
+            else if (split->isEmpty())
+                WARN << QString("%1: Desktop action '%2' skipped: Empty Exec value.")
+                            .arg(path, action_id);
+            else
+                desktop_actions_.emplace_back(*this, action_id, ::move(*name), ::move(*split));
         }
-    } catch (const out_of_range &) { }
 
     // // MimeType, string(s)
-    // try {
-    //     pe.mime_types = p.getString(root_section, QStringLiteral("MimeType")).split(';', Qt::SkipEmptyParts);
-    // } catch (const out_of_range &) { }
+    // if (const auto mime_types = p.getString(root_section, "MimeType"); mime_types)
+    //     pe.mime_types = mime_types->split(';', Qt::SkipEmptyParts);
     // pe.mime_types.removeDuplicates();
 
     names_.removeDuplicates();
 }
 
+Application::Application(const QString &id, const QString &path, QDataStream &stream)
+{
+    id_ = id;
+    path_ = path;
+
+    quint32 action_count;
+    stream >> names_ >> description_ >> icon_ >> exec_ >> working_dir_ >> term_ >> is_terminal_
+           >> action_count;
+
+    for (quint32 i = 0; i < action_count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString action_id, name;
+        QStringList exec;
+        stream >> action_id >> name >> exec;
+        desktop_actions_.emplace_back(*this, action_id, name, exec);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        throw runtime_error("Malformed data.");
+}
+
+void Application::write(QDataStream &stream) const
+{
+    stream << names_ << description_ << icon_ << exec_ << working_dir_ << term_ << is_terminal_
+           << (quint32)desktop_actions_.size();
+    for (const auto &action : desktop_actions_)
+        stream << action.id_ << action.name_ << action.exec_;
+}
+
 QString Application::subtext() const { return description_; }
 
 QStringList Application::iconUrls() const
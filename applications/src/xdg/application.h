@@ -5,6 +5,7 @@
 #include <QString>
 #include <QUrl>
 #include <albert/item.h>
+class QDataStream;
 
 class Application : public ApplicationBase
 {
@@ -22,6 +23,11 @@ public:
     Application(const QString &id, const QString &path, ParseOptions po);
     Application(const Application &) = default;
 
+    /// Restores an application written by write(), see ApplicationCache
+    /// @throws runtime_error if the data is malformed
+    Application(const QString &id, const QString &path, QDataStream &stream);
+    void write(QDataStream &stream) const;
+
     QString subtext() const override final;
     QStringList iconUrls() const override final;
     void launch() const override final;
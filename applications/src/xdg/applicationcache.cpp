@@ -0,0 +1,151 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "application.h"
+#include "applicationcache.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <albert/logging.h>
+using namespace std;
+
+static const quint32 CACHE_MAGIC = 0x41505043;  // APPC
+static const quint32 CACHE_VERSION = 1;
+
+ApplicationCache::ApplicationCache(QString file_path) : file_path_(::move(file_path)) {}
+
+ApplicationCache::Stamp ApplicationCache::stamp(const QString &path)
+{
+    QFileInfo fi(path);
+    return {fi.size(), fi.lastModified().toMSecsSinceEpoch()};
+}
+
+void ApplicationCache::setContext(quint64 context_hash)
+{
+    if (!loaded_)
+        load();
+
+    if (context_hash_ != context_hash)
+    {
+        if (!records_.empty())
+            DEBG << "Parse context changed, dropping cached desktop entries.";
+        context_hash_ = context_hash;
+        records_.clear();
+        modified_ = true;
+    }
+}
+
+optional<shared_ptr<Application>> ApplicationCache::lookup(const QString &id, const QString &path,
+                                                           const Stamp &stamp) const
+{
+    const auto it = records_.find(path);
+    if (it == records_.end() || !(it->second.stamp == stamp))
+        return nullopt;
+
+    if (it->second.skipped)
+        return shared_ptr<Application>();
+
+    try {
+        QDataStream stream(it->second.data);
+        stream.setVersion(QDataStream::Qt_6_0);
+        return make_shared<Application>(id, path, stream);
+    } catch (const exception &e) {
+        WARN << QString("Discarding cached desktop entry '%1': %2").arg(path, e.what());
+        return nullopt;
+    }
+}
+
+void ApplicationCache::insert(const QString &path, const Stamp &stamp,
+                              const Application *application)
+{
+    Record record{stamp, application == nullptr, {}};
+    if (application)
+    {
+        QDataStream stream(&record.data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_6_0);
+        application->write(stream);
+    }
+    records_.insert_or_assign(path, ::move(record));
+    modified_ = true;
+}
+
+void ApplicationCache::save(const set<QString> &paths)
+{
+    for (auto it = records_.begin(); it != records_.end();)
+        if (paths.contains(it->first))
+            ++it;
+        else
+        {
+            it = records_.erase(it);
+            modified_ = true;
+        }
+
+    if (!modified_)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QSaveFile file(file_path_);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        WARN << "Couldn't write to file:" << file.fileName();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << CACHE_MAGIC << CACHE_VERSION << context_hash_ << (quint32)records_.size();
+    for (const auto &[path, record] : records_)
+        stream << path << record.stamp.size << record.stamp.mtime << record.skipped << record.data;
+
+    if (file.commit())
+    {
+        modified_ = false;
+        DEBG << QString("Stored %1 desktop entries to '%2' in %3 ms.")
+                    .arg(records_.size()).arg(file_path_).arg(timer.elapsed());
+    }
+    else
+        WARN << "Failed storing desktop entry cache:" << file.errorString();
+}
+
+void ApplicationCache::load()
+{
+    loaded_ = true;
+
+    QFile file(file_path_);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic, version, count;
+    quint64 context_hash;
+    stream >> magic >> version >> context_hash >> count;
+    if (stream.status() != QDataStream::Ok || magic != CACHE_MAGIC || version != CACHE_VERSION)
+    {
+        WARN << "Ignoring desktop entry cache of unknown format or version.";
+        return;
+    }
+
+    map<QString, Record> records;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString path;
+        Record record;
+        stream >> path >> record.stamp.size >> record.stamp.mtime >> record.skipped >> record.data;
+        records.emplace(::move(path), ::move(record));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        WARN << "Ignoring truncated desktop entry cache.";
+        return;
+    }
+
+    context_hash_ = context_hash;
+    records_ = ::move(records);
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+class Application;
+
+///
+/// Parse results of desktop entries, persisted across runs
+///
+/// Records are keyed by the path of the desktop file and valid as long as the
+/// size and the modification time of the file and the parse context (options,
+/// locale, desktop environment) are unchanged. Skipped entries are cached as
+/// well. Not thread-safe.
+///
+class ApplicationCache
+{
+public:
+
+    explicit ApplicationCache(QString file_path);
+
+    /// Size and modification time of a desktop file
+    struct Stamp
+    {
+        qint64 size;
+        qint64 mtime;
+        bool operator==(const Stamp &) const = default;
+    };
+
+    static Stamp stamp(const QString &path);
+
+    /// Drops all records if the parse context changed. Loads the cache file on first use.
+    void setContext(quint64 context_hash);
+
+    /// @returns the cached parse result of the desktop file if its stamp is unchanged, a null
+    /// pointer for skipped entries, nullopt if there is no valid record
+    std::optional<std::shared_ptr<Application>> lookup(const QString &id, const QString &path,
+                                                       const Stamp &stamp) const;
+
+    /// Records the parse result of a desktop file, nullptr for skipped entries
+    void insert(const QString &path, const Stamp &stamp, const Application *application);
+
+    /// Drops the records of paths not in paths and writes the cache file if modified
+    void save(const std::set<QString> &paths);
+
+private:
+
+    struct Record
+    {
+        Stamp stamp;
+        bool skipped;
+        QByteArray data;  // see Application::write
+    };
+
+    void load();
+
+    const QString file_path_;
+    quint64 context_hash_ = 0;
+    std::map<QString, Record> records_;
+    bool loaded_ = false;
+    bool modified_ = false;
+
+};
@@ -1,142 +1,200 @@
 // Copyright (c) 2024-2024 Manuel Schneider
 
 #include "desktopentryparser.h"
-#include <QFile>
+#include <QLocale>
 #include <albert/logging.h>
+#include <cstring>
+#include <libintl.h>
+#include <stdexcept>
 using namespace std;
 
-DesktopEntryParser::DesktopEntryParser(const QString &path)
-{
-    if (QFile file(path); file.open(QIODevice::ReadOnly| QIODevice::Text))
-    {
-        QTextStream stream(&file);
-        QString currentGroup;
-        for (QString line=stream.readLine(); !line.isNull(); line=stream.readLine())
-        {
-            line = line.trimmed();
+static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
 
-            if (line.startsWith('#') || line.isEmpty())
-                continue;
+static QByteArrayView trimmed(QByteArrayView v)
+{
+    while (!v.isEmpty() && isSpace(v.front()))
+        v = v.sliced(1);
+    while (!v.isEmpty() && isSpace(v.back()))
+        v.chop(1);
+    return v;
+}
 
-            if (line.startsWith("["))
+// Locales of localized keys in order of preference, see "Localized values for keys" of the spec
+static const vector<QByteArray> &localeKeys()
+{
+    static const vector<QByteArray> keys = []
+    {
+        // QLocale has no modifiers, take it from the POSIX locale (lang_COUNTRY.ENCODING@MODIFIER)
+        QByteArray modifier;
+        for (const auto *var : {"LC_ALL", "LC_MESSAGES", "LANG"})
+            if (const auto value = qgetenv(var); !value.isEmpty())
             {
-                currentGroup = line.mid(1,line.size()-2).trimmed();
-                continue;
+                if (const auto i = value.indexOf('@'); i >= 0)
+                    modifier = value.mid(i);
+                break;
             }
 
-            data[currentGroup].emplace(line.section('=', 0,0).trimmed(),
-                                       line.section('=', 1, -1).trimmed());
+        const auto name = QLocale().name().toUtf8();  // lang_COUNTRY
+        const auto i = name.indexOf('_');
+        const auto lang = i < 0 ? name : name.left(i);
+
+        vector<QByteArray> k;
+        if (i >= 0 && !modifier.isEmpty())
+            k.emplace_back(name + modifier);
+        if (i >= 0)
+            k.emplace_back(name);
+        if (!modifier.isEmpty())
+            k.emplace_back(lang + modifier);
+        k.emplace_back(lang);
+        return k;
+    }();
+    return keys;
+}
+
+DesktopEntryParser::DesktopEntryParser(const QString &path) : file_(path)
+{
+    if (!file_.open(QIODevice::ReadOnly))
+        throw runtime_error(QString("Failed opening file '%1': %2")
+                                .arg(path, file_.errorString()).toStdString());
+
+    const auto size = file_.size();
+    if (size == 0)
+        return;
+
+    const auto *data = reinterpret_cast<const char*>(file_.map(0, size));
+    if (!data)
+        throw runtime_error(QString("Failed mapping file '%1': %2")
+                                .arg(path, file_.errorString()).toStdString());
+
+    // Single pass, views into the mapped file only
+    groups_.push_back({});  // entries preceding the first group header
+    for (const char *p = data, *end = data + size; p < end;)
+    {
+        const auto *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        const auto line = trimmed(QByteArrayView(p, eol - p));
+        p = eol + 1;
+
+        if (line.isEmpty() || line.front() == '#')
+            continue;
+
+        if (line.front() == '[')
+        {
+            groups_.push_back({trimmed(line.sliced(1, line.size() - (line.back() == ']' ? 2 : 1))), {}});
+            continue;
+        }
+
+        const auto eq = line.indexOf('=');
+        if (eq < 0)
+            continue;
+
+        auto key = trimmed(line.first(eq));
+        QByteArrayView locale;
+        if (const auto lb = key.indexOf('['); lb >= 0 && key.back() == ']')
+        {
+            locale = key.sliced(lb + 1, key.size() - lb - 2);
+            key.truncate(lb);
         }
-        file.close();
+        groups_.back().entries.push_back({key, locale, trimmed(line.sliced(eq + 1))});
     }
-    else
-        throw runtime_error(QString("Failed opening file '%1': %2").arg(path, file.errorString()).toStdString());
 }
 
-QString DesktopEntryParser::getRawValue(const QString &section, const QString &key) const
+const QByteArrayView *DesktopEntryParser::rawValue(QByteArrayView section, QByteArrayView key,
+                                                   QByteArrayView locale) const
 {
-    class SectionDoesNotExist : public std::out_of_range { using out_of_range::out_of_range; };
-    class KeyDoesNotExist : public std::out_of_range { using out_of_range::out_of_range; };
-
-    try {
-        auto &s = data.at(section);
-        try {
-            return s.at(key);
-        } catch (const out_of_range&) {
-            throw KeyDoesNotExist(QString("Section '%1' does not contain a key '%2'.")
-                                  .arg(section, key).toStdString());
+    // The first occurrence wins
+    for (const auto &group : groups_)
+        if (group.name == section)
+        {
+            for (const auto &entry : group.entries)
+                if (entry.key == key && entry.locale == locale)
+                    return &entry.value;
+            return nullptr;
         }
-    } catch (const out_of_range&) {
-        throw SectionDoesNotExist(QString("Desktop entry does not contain a section '%1'.")
-                                  .arg(section).toStdString());
-    }
+    return nullptr;
 }
 
-QString DesktopEntryParser::getEscapedValue(const QString &section, const QString &key) const
+QString DesktopEntryParser::unescaped(QByteArrayView raw)
 {
-    QString result;
+    if (!raw.contains('\\'))
+        return QString::fromUtf8(raw);
 
-    auto unescaped = getRawValue(section, key);
-    for (auto it = unescaped.cbegin(); it != unescaped.cend();)
+    QByteArray result;
+    result.reserve(raw.size());
+    for (auto it = raw.begin(); it != raw.end(); ++it)
     {
-        if (*it == '\\'){
-            ++it;
-            if (it == unescaped.cend())
+        if (*it == '\\')
+        {
+            if (++it == raw.end())
                 break;
-            else if (*it=='s')
+            else if (*it == 's')
                 result.append(' ');
-            else if (*it=='n')
+            else if (*it == 'n')
                 result.append('\n');
-            else if (*it=='t')
+            else if (*it == 't')
                 result.append('\t');
-            else if (*it=='r')
+            else if (*it == 'r')
                 result.append('\r');
-            else if (*it=='\\')
+            else if (*it == '\\')
                 result.append('\\');
         }
         else
             result.append(*it);
-        ++it;
     }
-
-    return result;
+    return QString::fromUtf8(result);
 }
 
-QString DesktopEntryParser::getString(const QString &section, const QString &key) const
+optional<QString> DesktopEntryParser::getString(QByteArrayView section, QByteArrayView key) const
 {
-    return getEscapedValue(section, key);
+    if (const auto *raw = rawValue(section, key); raw)
+        return unescaped(*raw);
+    return nullopt;
 }
 
-QString DesktopEntryParser::getLocaleString(const QString &section, const QString &key)
+optional<QString> DesktopEntryParser::getLocaleString(QByteArrayView section,
+                                                      QByteArrayView key) const
 {
     // https://wiki.ubuntu.com/UbuntuDevelopment/Internationalisation/Packaging#Desktop_Entries
 
+    for (const auto &locale : localeKeys())
+        if (const auto *raw = rawValue(section, key, locale); raw)
+            return unescaped(*raw);
 
-    // TODO: Properly fetch the localestring
-    //       (lang_COUNTRY@MODIFIER, lang_COUNTRY, lang@MODIFIER, lang, default value)
+    const auto *raw = rawValue(section, key);
+    if (!raw)
+        return nullopt;
 
-    try {
-        return getEscapedValue(section, QString("%1[%2]").arg(key, locale.name()));
-    } catch (const out_of_range&) { }
-
-    try {
-        return getEscapedValue(section, QString("%1[%2]").arg(key, locale.name().left(2)));
-    } catch (const out_of_range&) { }
-
-    QString unlocalized = getEscapedValue(section, key);
-
-    try {
-        auto domain = getEscapedValue(section, QStringLiteral("X-Ubuntu-Gettext-Domain"));
+    if (const auto *domain = rawValue(section, "X-Ubuntu-Gettext-Domain"); domain)
+    {
         // The resulting string is statically allocated and must not be modified or freed
         // Returns msgid on lookup failure
         // https://linux.die.net/man/3/dgettext
-        return QString::fromUtf8(dgettext(domain.toStdString().c_str(),
-                                          unlocalized.toStdString().c_str()));
-    } catch (const out_of_range&) { }
+        const auto msgid = unescaped(*raw).toUtf8();
+        return QString::fromUtf8(dgettext(unescaped(*domain).toUtf8().constData(),
+                                          msgid.constData()));
+    }
 
-    return unlocalized;
+    return unescaped(*raw);
 }
 
-QString DesktopEntryParser::getIconString(const QString &section, const QString &key)
+optional<QString> DesktopEntryParser::getIconString(QByteArrayView section, QByteArrayView key) const
 {
-    return getEscapedValue(section, key);
+    return getString(section, key);
 }
 
-bool DesktopEntryParser::getBoolean(const QString &section, const QString &key)
+optional<bool> DesktopEntryParser::getBoolean(QByteArrayView section, QByteArrayView key) const
 {
-    auto raw = getRawValue(section, key);  // throws
-    if (raw == QStringLiteral("true"))
+    const auto *raw = rawValue(section, key);
+    if (!raw)
+        return nullopt;
+    else if (*raw == "true")
         return true;
-    else if (raw == QStringLiteral("false"))
+    else if (*raw == "false")
         return false;
     else
         throw runtime_error(QString("Value for key '%1' in section '%2' is neither true nor false.")
-                              .arg(key, section).toStdString());
-}
-
-double DesktopEntryParser::getNumeric(const QString &, const QString &)
-{
-    throw runtime_error("Not implemented.");
+                                .arg(QString::fromUtf8(key), QString::fromUtf8(section)).toStdString());
 }
 
 optional<QStringList> DesktopEntryParser::splitExec(const QString &s) noexcept
@@ -1,20 +1,27 @@
 // Copyright (c) 2024-2024 Manuel Schneider
 
 #pragma once
-#include <QLocale>
+#include <QByteArrayView>
+#include <QFile>
 #include <QString>
-#include <map>
+#include <QStringList>
 #include <optional>
+#include <vector>
 
 ///
 /// Desktop entry parser
 ///
 /// http://standards.freedesktop.org/desktop-entry-spec/latest/
 ///
+/// Maps the file and scans it once into views of the groups, keys and values.
+/// Strings are materialized on request only. Lookups of missing keys return
+/// nullopt.
+///
 class DesktopEntryParser
 {
 public:
 
+    /// @throws runtime_error if the file can not be read
     DesktopEntryParser(const QString &path);
 
     /// Get and escape string according to spec
@@ -22,21 +29,22 @@ public:
     /// Values of type string may contain all ASCII characters except for
     /// control characters.
     ///
-    /// @returns The escaped string of the key in section
+    /// @returns The escaped string of the key in section, nullopt if missing
     /// @param section The section to get the value from
     /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    QString getString(const QString &section, const QString &key) const;
+    std::optional<QString> getString(QByteArrayView section, QByteArrayView key) const;
 
     /// Get localestring according to spec
     ///
     /// Values of type localestring are user displayable, and are encoded in UTF-8.
+    /// Localized keys are matched in the order lang_COUNTRY@MODIFIER, lang_COUNTRY,
+    /// lang@MODIFIER and lang. The default value is translated using gettext if the
+    /// section specifies a domain.
     ///
-    /// @returns The localestring of the key in section
+    /// @returns The localestring of the key in section, nullopt if missing
     /// @param section The section to get the value from
     /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    QString getLocaleString(const QString &section, const QString &key);
+    std::optional<QString> getLocaleString(QByteArrayView section, QByteArrayView key) const;
 
     /// Get iconstring according to spec
     ///
@@ -45,59 +53,49 @@ public:
     /// algorithm described in the Icon Theme Specification. Such values
     /// are not user-displayable, and are encoded in UTF-8.
     ///
-    /// @returns The iconstring of the key in section
+    /// @returns The iconstring of the key in section, nullopt if missing
     /// @param section The section to get the value from
     /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    QString getIconString(const QString &section, const QString &key);
+    std::optional<QString> getIconString(QByteArrayView section, QByteArrayView key) const;
 
     /// Get boolean according to spec
     ///
     /// Values of type boolean must either be the string true or false.
     ///
-    /// @returns The boolean of the key in section
-    /// @param section The section to get the value from
-    /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    bool getBoolean(const QString &section, const QString &key);
-
-    /// Get numeric according to spec
-    ///
-    /// Values of type numeric must be a valid floating point number as
-    /// recognized by the %f specifier for scanf in the C locale.
-    ///
-    /// @returns The numeric of the key in section
+    /// @returns The boolean of the key in section, nullopt if missing
     /// @param section The section to get the value from
     /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    double getNumeric(const QString &, const QString &);
+    /// @throws runtime_error if the value is neither true nor false
+    std::optional<bool> getBoolean(QByteArrayView section, QByteArrayView key) const;
 
     /// Split an Exec string according to spec
     static std::optional<QStringList> splitExec(const QString &s) noexcept;
 
 private:
 
-    /// Get a raw, unescaped value for a section and key.
-    ///
-    /// @returns The raw, unescaped string of the key in section
-    /// @param section The section to get the value from
-    /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    QString getRawValue(const QString &section, const QString &key) const;
+    struct Entry
+    {
+        QByteArrayView key;
+        QByteArrayView locale;  // empty if not localized
+        QByteArrayView value;  // raw, still escaped
+    };
+
+    struct Group
+    {
+        QByteArrayView name;
+        std::vector<Entry> entries;
+    };
+
+    /// @returns The raw value of the key in section, nullptr if missing
+    const QByteArrayView *rawValue(QByteArrayView section, QByteArrayView key,
+                                   QByteArrayView locale = {}) const;
 
-    /// Get an escaped value for a section and key.
-    ///
     /// The escape sequences \s, \n, \t, \r, and \\ are supported for values of
     /// type string, localestring and iconstring, meaning ASCII space, newline,
     /// tab, carriage return, and backslash, respectively.
-    ///
-    /// @returns The escaped string of the key in section
-    /// @param section The section to get the value from
-    /// @param key The key to the value for
-    /// @throws out_of_range if lookup failed
-    QString getEscapedValue(const QString &section, const QString &key) const;
+    static QString unescaped(QByteArrayView raw);
 
-    std::map<QString, std::map<QString,QString>> data;
-    QLocale locale;
+    QFile file_;  // mapped, views point into it
+    std::vector<Group> groups_;
 
 };
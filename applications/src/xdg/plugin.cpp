@@ -4,9 +4,14 @@
 #include "plugin.h"
 #include "terminal.h"
 #include "ui_configwidget.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QLocale>
 #include <QRegularExpression>
 #include <QStandardPaths>
 #include <QWidget>
+#include <QtConcurrentMap>
+#include <albert/albert.h>
 using namespace std;
 using namespace albert;
 
@@ -107,19 +112,28 @@ const map<QString, QStringList> Plugin::exec_args  // command > ExecArg
     // {"zutty", {}},
 };
 
+// Parse results depend on the options, the locale and the desktop environment
+static quint64 parseContextHash(const Application::ParseOptions &po)
+{
+    return qHashMulti(0, po.ignore_show_in_keys, po.use_exec, po.use_generic_name,
+                      po.use_keywords, po.use_non_localized_name, QLocale().name(),
+                      qEnvironmentVariable("LANGUAGE"), qEnvironmentVariable("XDG_CURRENT_DESKTOP"));
+}
+
+static const int RESCAN_DELAY = 1000;  // ms
+
 static QStringList appDirectories()
 { return QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation); }
 
 Plugin* plugin = nullptr;
 
-Plugin::Plugin()
+Plugin::Plugin():
+    cache(QDir(cacheLocation()).filePath("desktop_entries.bin"))
 {
     qunsetenv("DESKTOP_AUTOSTART_ID");
     plugin = this;
 
-    fs_watcher.addPaths(appDirectories());
-    connect(&fs_watcher, &QFileSystemWatcher::directoryChanged, this, &Plugin::updateIndexItems);
-
+    tryCreateDirectory(cacheLocation());
 
     // Load settings
 
@@ -146,20 +160,27 @@ Plugin::Plugin()
             this, &Plugin::updateIndexItems);
 
 
-    // File watches
+    // File watches. Package upgrades touch many files in bursts, hence changes are coalesced.
+    // The indexer reparses added and modified desktop entries only.
 
-    for (const auto &path : QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation))
+    for (const auto &path : appDirectories())
         for (auto dit = QDirIterator(path, QDir::Dirs|QDir::NoDotDot, QDirIterator::Subdirectories); dit.hasNext();)
             fs_watcher.addPath(QFileInfo(dit.next()).canonicalFilePath());
 
+    rescan_timer.setSingleShot(true);
+    rescan_timer.setInterval(RESCAN_DELAY);
     connect(&fs_watcher, &QFileSystemWatcher::directoryChanged,
-            this, [this](){ indexer.run(); });
+            &rescan_timer, qOverload<>(&QTimer::start));
+    connect(&rescan_timer, &QTimer::timeout, this, [this]{ indexer.run(); });
 
 
     // Indexer
 
     indexer.parallel = [this](const bool &abort) -> vector<shared_ptr<applications::Application>>
     {
+        QElapsedTimer timer;
+        timer.start();
+
         // Get a map of unique desktop entries according to the spec
 
         map<QString, QString> desktop_files;  // Desktop id > path
@@ -194,61 +215,140 @@ Plugin::Plugin()
             .use_non_localized_name = use_non_localized_name()
         };
 
-        // Index the unique desktop files
-        vector<shared_ptr<applications::Application>> apps;
-        for (const auto &[id, path] : desktop_files)
+        discovery_runtime = timer.restart();
+
+        // Reuse the results of the last run for unchanged desktop entries, restore the others
+        // from the cache or parse them in parallel. Results are stored by index, hence sorted
+        // by desktop id regardless of the scheduling.
+        using Apps = vector<shared_ptr<applications::Application>>;
+        const auto parse = [&abort, &po](const pair<QString, QString> &entry) -> Apps::value_type
         {
+            const auto &[id, path] = entry;
             if (abort)
-                return apps;
+                return {};
 
             try
             {
-                apps.emplace_back(make_shared<Application>(id, path, po));
+                auto app = make_shared<Application>(id, path, po);
                 DEBG << QString("Valid desktop file '%1': '%2'").arg(id, path);
+                return app;
             }
             catch (const exception &e)
             {
                 DEBG << QString("Skipped desktop entry '%1': %2").arg(path, e.what());
+                return {};
+            }
+        };
+        const vector<pair<QString, QString>> entries(desktop_files.begin(), desktop_files.end());
+        vector<ApplicationCache::Stamp> stamps;
+        stamps.reserve(entries.size());
+        Apps parsed(entries.size());
+        vector<size_t> misses;
+        size_t reused = 0;
+        const auto context = parseContextHash(po);
+        if (context != indexed_context)
+        {
+            indexed_entries.clear();
+            indexed_context = context;
+        }
+        cache.setContext(context);
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const auto &[id, path] = entries[i];
+            stamps.emplace_back(ApplicationCache::stamp(path));
+            if (auto it = indexed_entries.find(id); it != indexed_entries.end()
+                && it->second.path == path && it->second.stamp == stamps.back())
+            {
+                parsed[i] = it->second.application;
+                ++reused;
             }
+            else if (auto cached = cache.lookup(id, path, stamps.back()); cached)
+                parsed[i] = ::move(*cached);
+            else
+                misses.emplace_back(i);
         }
 
+        QtConcurrent::blockingMap(misses, [&](size_t i){ parsed[i] = parse(entries[i]); });
+
+        if (abort)
+            return {};
+
+        DEBG << QString("Desktop entries: %1 unchanged, %2 restored from the cache, %3 parsed.")
+                    .arg(reused).arg(entries.size() - misses.size() - reused).arg(misses.size());
+
+        for (auto i : misses)
+            cache.insert(entries[i].second, stamps[i],
+                         static_cast<const Application*>(parsed[i].get()));
+        set<QString> paths;
+        for (const auto &[id, path] : entries)
+            paths.insert(path);
+        cache.save(paths);
+
+        indexed_entries.clear();
+        for (size_t i = 0; i < entries.size(); ++i)
+            indexed_entries.emplace(entries[i].first,
+                                    IndexedEntry{entries[i].second, stamps[i], parsed[i]});
+
+        Apps apps;
+        apps.reserve(parsed.size());
+        for (auto &app : parsed)
+            if (app)
+                apps.emplace_back(::move(app));
+
+        parse_runtime = timer.elapsed();
+
         return apps;
     };
 
     indexer.finish = [this](vector<shared_ptr<applications::Application>> &&result)
     {
-        applications = ::move(result);
+        QElapsedTimer timer;
+        timer.start();
 
-        INFO << QStringLiteral("Indexed %1 applications [%2 ms]")
-                    .arg(applications.size()).arg(indexer.runtime.count());
+        applications = ::move(result);
 
         // Replace terminal apps with terminals and populate terminals
         // Filter supported terms by availability using destkop id
+        // Terminals of unchanged apps are reused to keep their index items
 
         terminals.clear();
+        decltype(terminal_apps) terms;
 
         for (auto &base : applications)
             if (auto app = static_pointer_cast<::Application>(base);
                 app->isTerminal())
             {
-                if (auto command = normalizedContainerCommand(app->exec());
-                    !command.isEmpty())
-                    if (auto it = exec_args.find(command); it != exec_args.end())
-                    {
-                        auto term = make_shared<Terminal>(*app, it->second);
-                        base = static_pointer_cast<::Application>(term);
-                        terminals.emplace_back(term.get());
-                    }
+                shared_ptr<Terminal> term;
+                if (auto it = terminal_apps.find(base); it != terminal_apps.end())
+                    term = it->second;
+                else if (auto command = normalizedContainerCommand(app->exec());
+                         !command.isEmpty())
+                    if (auto eit = exec_args.find(command); eit != exec_args.end())
+                        term = make_shared<Terminal>(*app, eit->second);
                     else
                         WARN << QString("Terminal '%1' not supported. Please post an issue. Exec: %2")
                                     .arg(app->id(), app->exec().join(" "));
                 else
                     WARN << QString("Failed to get normalized command. Terminal '%1' not supported. Please post an issue. Exec: %2")
                                 .arg(app->id(), app->exec().join(" "));
+
+                if (term)
+                {
+                    terms.emplace(base, term);
+                    base = static_pointer_cast<::Application>(term);
+                    terminals.emplace_back(term.get());
+                }
             }
 
+        terminal_apps = ::move(terms);
+
         setUserTerminalFromConfig();
 
+        INFO << QStringLiteral("Indexed %1 applications [%2 ms] (discovery %3 ms, parse %4 ms, "
+                               "terminal resolution %5 ms)")
+                    .arg(applications.size()).arg(indexer.runtime.count())
+                    .arg(discovery_runtime).arg(parse_runtime).arg(timer.elapsed());
+
         setIndexItems(buildIndexItems());
 
         emit appsChanged();
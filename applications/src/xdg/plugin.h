@@ -1,9 +1,12 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
 #pragma once
+#include "applicationcache.h"
 #include "pluginbase.h"
 #include <QStringList>
+#include <QTimer>
 #include <albert/telemetryprovider.h>
+class Terminal;
 
 class Plugin : public PluginBase,
                public albert::TelemetryProvider
@@ -34,4 +37,26 @@ private:
     ALBERT_PLUGIN_PROPERTY(bool, use_generic_name, false)
     ALBERT_PLUGIN_PROPERTY(bool, use_keywords, false)
 
+    // Phase runtimes of the last indexer run [ms], set by the indexer thread
+    qint64 discovery_runtime = 0;
+    qint64 parse_runtime = 0;
+
+    ApplicationCache cache;  // used by the indexer thread only
+
+    // Parse results of the last indexer run by desktop id, used by the indexer thread only.
+    // Unchanged entries keep their objects and hence their index items.
+    struct IndexedEntry
+    {
+        QString path;
+        ApplicationCache::Stamp stamp;
+        std::shared_ptr<applications::Application> application;  // null if skipped
+    };
+    std::map<QString, IndexedEntry> indexed_entries;
+    quint64 indexed_context = 0;
+
+    // Terminals by the parsed application they were created from
+    std::map<std::shared_ptr<applications::Application>, std::shared_ptr<Terminal>> terminal_apps;
+
+    QTimer rescan_timer;  // coalesces file system changes
+
 };
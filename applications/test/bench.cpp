@@ -0,0 +1,83 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "application.h"
+#include "bench.h"
+#include "desktopentryparser.h"
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QStandardPaths>
+using namespace std;
+
+
+QTEST_APPLESS_MAIN(ApplicationsBenchmarks)
+
+
+// Desktop entries of the system, or of APPLICATIONS_BENCH_DIR if set
+void ApplicationsBenchmarks::initTestCase()
+{
+    auto dirs = QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation);
+    if (const auto dir = qEnvironmentVariable("APPLICATIONS_BENCH_DIR"); !dir.isEmpty())
+        dirs = {dir};
+
+    for (const auto &dir : dirs)
+        for (QDirIterator it(dir, {"*.desktop"}, QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
+            paths << it.next();
+
+    if (paths.isEmpty())
+        QSKIP("No desktop entries found.");
+
+    qDebug() << "Desktop entries:" << paths.size();
+}
+
+// The parser alone, requesting the keys Application reads
+void ApplicationsBenchmarks::parse_entries()
+{
+    const QByteArrayView s = "Desktop Entry";
+    uint parsed = 0;
+
+    QBENCHMARK {
+        parsed = 0;
+        for (const auto &path : as_const(paths))
+            try
+            {
+                DesktopEntryParser p(path);
+                for (const char *key : {"Categories", "Type", "NotShowIn", "OnlyShowIn", "Exec",
+                                        "Path", "Actions"})
+                    p.getString(s, key);
+                for (const char *key : {"Name", "Comment", "Keywords", "Icon", "GenericName"})
+                    p.getLocaleString(s, key);
+                for (const char *key : {"NoDisplay", "Terminal"})
+                    try { p.getBoolean(s, key); } catch (const runtime_error &) { }
+                ++parsed;
+            }
+            catch (const runtime_error &) { }
+    }
+
+    QVERIFY(parsed > 0);
+}
+
+// Full construction, as done by the indexer
+void ApplicationsBenchmarks::parse_applications()
+{
+    const Application::ParseOptions po{
+        .ignore_show_in_keys = true,
+        .use_exec = true,
+        .use_generic_name = true,
+        .use_keywords = true,
+        .use_non_localized_name = true
+    };
+    uint applications = 0;
+
+    QBENCHMARK {
+        applications = 0;
+        for (const auto &path : as_const(paths))
+            try
+            {
+                Application application(QFileInfo(path).fileName(), path, po);
+                ++applications;
+            }
+            catch (const runtime_error &) { }
+    }
+
+    qDebug() << "Applications:" << applications;
+}
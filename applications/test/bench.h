@@ -0,0 +1,21 @@
+// Copyright (c) 2026 Manuel Schneider
+#include <QCoreApplication>
+#include <QStringList>
+#include <QtTest/QtTest>
+
+class ApplicationsBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void parse_entries();
+    void parse_applications();
+
+private:
+
+    QStringList paths;
+
+};
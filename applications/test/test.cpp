@@ -0,0 +1,417 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "application.h"
+#include "applicationcache.h"
+#include "desktopentryparser.h"
+#include "test.h"
+#include <QFile>
+#include <QLocale>
+using namespace std;
+
+
+QTEST_APPLESS_MAIN(ApplicationsTests)
+
+static const Application::ParseOptions po{
+    .ignore_show_in_keys = true,
+    .use_exec = false,
+    .use_generic_name = true,
+    .use_keywords = true,
+    .use_non_localized_name = true
+};
+
+static const QByteArray app_entry = R"([Desktop Entry]
+Type=Application
+Name=App
+Name[de]=Anwendung
+GenericName=Editor
+Comment=Edits things
+Keywords=edit;text;
+Icon=accessories-text-editor
+Exec=app --flag %U
+Terminal=true
+Actions=new-window;
+
+[Desktop Action new-window]
+Name=New Window
+Exec=app --new-window
+)";
+
+static const QByteArray hidden_entry = R"([Desktop Entry]
+Type=Application
+Name=Hidden
+Exec=hidden
+NoDisplay=true
+)";
+
+
+// The locale keys are determined once, before the first lookup
+void ApplicationsTests::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    qputenv("LC_ALL", "de_DE.UTF-8@euro");
+    QLocale::setDefault(QLocale("de_DE"));
+}
+
+QString ApplicationsTests::writeFile(const QString &name, const QByteArray &content)
+{
+    QFile file(dir.filePath(name));
+    if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size())
+        qFatal("Failed writing %s", qPrintable(file.fileName()));
+    return file.fileName();
+}
+
+void ApplicationsTests::parser_locale_fallback()
+{
+    const auto path = writeFile("locale.desktop", R"([Desktop Entry]
+A[de_DE@euro]=1
+A[de_DE]=2
+A[de@euro]=3
+A[de]=4
+A=5
+B[de_DE]=2
+B[de@euro]=3
+B[de]=4
+B=5
+C[de@euro]=3
+C[de]=4
+C=5
+D[de]=4
+D[fr]=x
+D=5
+E[de_AT]=x
+E[en]=x
+E=5
+F[de]=4
+
+[Gettext]
+X-Ubuntu-Gettext-Domain=albert-tests-nonexistent
+Name=Files
+)");
+
+    DesktopEntryParser p(path);
+    const QByteArrayView s = "Desktop Entry";
+
+    // lang_COUNTRY@MODIFIER, lang_COUNTRY, lang@MODIFIER, lang, default
+    QCOMPARE(p.getLocaleString(s, "A"), "1");
+    QCOMPARE(p.getLocaleString(s, "B"), "2");
+    QCOMPARE(p.getLocaleString(s, "C"), "3");
+    QCOMPARE(p.getLocaleString(s, "D"), "4");
+    QCOMPARE(p.getLocaleString(s, "E"), "5");
+    QCOMPARE(p.getLocaleString(s, "F"), "4");
+    QCOMPARE(p.getLocaleString(s, "G"), nullopt);
+
+    // Strings are not localized
+    QCOMPARE(p.getString(s, "A"), "5");
+    QCOMPARE(p.getString(s, "F"), nullopt);
+
+    // Missing translations yield the default
+    QCOMPARE(p.getLocaleString("Gettext", "Name"), "Files");
+}
+
+void ApplicationsTests::parser_escapes()
+{
+    const auto path = writeFile("escapes.desktop", R"([Desktop Entry]
+S=a\sb\nc\td\re\\f
+T=no escapes
+U=trailing\
+V=\\s
+L[de]=Grüße\sund\tso
+I=/icons/my\sicon.png
+  W  =  padded value
+X=
+)");
+
+    DesktopEntryParser p(path);
+    const QByteArrayView s = "Desktop Entry";
+
+    QCOMPARE(p.getString(s, "S"), "a b\nc\td\re\\f");
+    QCOMPARE(p.getString(s, "T"), "no escapes");
+    QCOMPARE(p.getString(s, "U"), "trailing");
+    QCOMPARE(p.getString(s, "V"), "\\s");
+    QCOMPARE(p.getLocaleString(s, "L"), "Grüße und\tso");
+    QCOMPARE(p.getIconString(s, "I"), "/icons/my icon.png");
+    QCOMPARE(p.getString(s, "W"), "padded value");
+    QCOMPARE(p.getString(s, "X"), "");
+
+    // Exec values are unescaped, then split
+    QCOMPARE(DesktopEntryParser::splitExec(R"(app "a b" "c\"d" "\\$e" f)"),
+             QStringList({"app", "a b", "c\"d", "\\$e", "f"}));
+    QCOMPARE(DesktopEntryParser::splitExec(R"(app "unterminated)"), nullopt);
+    QCOMPARE(DesktopEntryParser::splitExec(R"(app "\x")"), nullopt);
+}
+
+void ApplicationsTests::parser_groups()
+{
+    const auto path = writeFile("groups.desktop",
+                                "Before=ignored\n"
+                                "# Comment\n"
+                                "[Desktop Entry]\n"
+                                "Name=App\n"
+                                "Type=Application\n"
+                                "\n"
+                                "[Desktop Action new-window]\n"
+                                "Name=New Window\n"
+                                "Exec=app --new-window --x=1\n"
+                                "\n"
+                                "[Desktop Action empty]\n"
+                                "[Other Group]\r\n"
+                                "Name=Other\r\n"
+                                "Last=no newline");
+
+    DesktopEntryParser p(path);
+
+    QCOMPARE(p.getString("Desktop Entry", "Name"), "App");
+    QCOMPARE(p.getString("Desktop Entry", "Before"), nullopt);
+    QCOMPARE(p.getString("Desktop Entry", "Exec"), nullopt);
+    QCOMPARE(p.getString("Desktop Action new-window", "Name"), "New Window");
+    QCOMPARE(p.getString("Desktop Action new-window", "Exec"), "app --new-window --x=1");
+    QCOMPARE(p.getString("Desktop Action new-window", "Type"), nullopt);
+    QCOMPARE(p.getString("Desktop Action empty", "Name"), nullopt);
+    QCOMPARE(p.getString("Other Group", "Name"), "Other");
+    QCOMPARE(p.getString("Other Group", "Last"), "no newline");
+    QCOMPARE(p.getString("Missing", "Name"), nullopt);
+
+    // Empty files are valid, missing ones are not
+    DesktopEntryParser empty(writeFile("empty.desktop", {}));
+    QCOMPARE(empty.getString("Desktop Entry", "Name"), nullopt);
+    QVERIFY_THROWS_EXCEPTION(runtime_error, DesktopEntryParser(dir.filePath("missing.desktop")));
+}
+
+void ApplicationsTests::parser_duplicate_keys()
+{
+    const auto path = writeFile("duplicates.desktop", R"([Desktop Entry]
+Name=First
+Name=Second
+Name[de]=Erste
+Name[de]=Zweite
+Terminal=false
+Terminal=true
+)");
+
+    DesktopEntryParser p(path);
+    const QByteArrayView s = "Desktop Entry";
+
+    // The first occurrence wins
+    QCOMPARE(p.getString(s, "Name"), "First");
+    QCOMPARE(p.getLocaleString(s, "Name"), "Erste");
+    QCOMPARE(p.getBoolean(s, "Terminal"), false);
+}
+
+void ApplicationsTests::parser_booleans()
+{
+    const auto path = writeFile("booleans.desktop", R"([Desktop Entry]
+A=true
+B=false
+C=True
+D=yes
+E=1
+F=
+G= true
+)");
+
+    DesktopEntryParser p(path);
+    const QByteArrayView s = "Desktop Entry";
+
+    QCOMPARE(p.getBoolean(s, "A"), true);
+    QCOMPARE(p.getBoolean(s, "B"), false);
+    QCOMPARE(p.getBoolean(s, "G"), true);
+    QCOMPARE(p.getBoolean(s, "Missing"), nullopt);
+
+    // Case sensitive, no other literals
+    QVERIFY_THROWS_EXCEPTION(runtime_error, p.getBoolean(s, "C"));
+    QVERIFY_THROWS_EXCEPTION(runtime_error, p.getBoolean(s, "D"));
+    QVERIFY_THROWS_EXCEPTION(runtime_error, p.getBoolean(s, "E"));
+    QVERIFY_THROWS_EXCEPTION(runtime_error, p.getBoolean(s, "F"));
+}
+
+void ApplicationsTests::application_name()
+{
+    const Application app("name", writeFile("name.desktop", app_entry), po);
+    QCOMPARE(app.names().mid(0, 2), QStringList({"Anwendung", "App"}));
+
+    // Localized names do not replace the required one
+    const auto path = writeFile("localized-only.desktop", R"([Desktop Entry]
+Type=Application
+Name[de]=Anwendung
+Exec=app
+)");
+    QVERIFY_THROWS_EXCEPTION(runtime_error, Application("localized-only", path, po));
+}
+
+void ApplicationsTests::cache_round_trip()
+{
+    const auto app_path = writeFile("cache-app.desktop", app_entry);
+    const auto hidden_path = writeFile("cache-hidden.desktop", hidden_entry);
+    const auto cache_path = dir.filePath("round_trip.bin");
+
+    const Application app("cache-app", app_path, po);
+    QVERIFY_THROWS_EXCEPTION(runtime_error, Application("cache-hidden", hidden_path, po));
+
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        cache.insert(app_path, ApplicationCache::stamp(app_path), &app);
+        cache.insert(hidden_path, ApplicationCache::stamp(hidden_path), nullptr);
+        cache.save({app_path, hidden_path});
+    }
+    QVERIFY(QFile::exists(cache_path));
+
+    ApplicationCache cache(cache_path);
+    cache.setContext(42);
+
+    const auto cached = cache.lookup("cache-app", app_path, ApplicationCache::stamp(app_path));
+    QVERIFY(cached.has_value());
+    QVERIFY(*cached);
+    const auto &restored = **cached;
+    QCOMPARE(restored.id(), "cache-app");
+    QCOMPARE(restored.path(), app_path);
+    QCOMPARE(restored.names(), app.names());
+    QCOMPARE(restored.names(), QStringList({"Anwendung", "App", "edit", "text", "Editor"}));
+    QCOMPARE(restored.subtext(), "Edits things");
+    QCOMPARE(restored.iconUrls(), app.iconUrls());
+    QCOMPARE(restored.exec(), QStringList({"app", "--flag", "%U"}));
+    QCOMPARE(restored.isTerminal(), app.isTerminal());
+
+    QStringList action_ids, restored_action_ids;
+    for (const auto &action : app.actions())
+        action_ids << action.id;
+    for (const auto &action : restored.actions())
+        restored_action_ids << action.id;
+    QCOMPARE(restored_action_ids, action_ids);
+    QVERIFY(restored_action_ids.contains("action-new-window"));
+
+    // Skipped entries are cached as null
+    const auto skipped = cache.lookup("cache-hidden", hidden_path,
+                                      ApplicationCache::stamp(hidden_path));
+    QVERIFY(skipped.has_value());
+    QVERIFY(!*skipped);
+
+    // Unknown paths
+    QCOMPARE(cache.lookup("unknown", dir.filePath("unknown.desktop"), {0, 0}), nullopt);
+}
+
+void ApplicationsTests::cache_stamp_invalidation()
+{
+    const auto path = writeFile("stamp.desktop", app_entry);
+    const auto cache_path = dir.filePath("stamp.bin");
+    const auto stamp = ApplicationCache::stamp(path);
+    const Application app("stamp", path, po);
+
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        cache.insert(path, stamp, &app);
+        cache.save({path});
+    }
+
+    ApplicationCache cache(cache_path);
+    cache.setContext(42);
+    QVERIFY(cache.lookup("stamp", path, stamp).has_value());
+
+    // Same size, modified later
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    const auto mtime = file.fileTime(QFileDevice::FileModificationTime);
+    file.write(QByteArray(app_entry).replace("Name=App\n", "Name=Foo\n"));
+    QVERIFY(file.setFileTime(mtime.addSecs(1), QFileDevice::FileModificationTime));
+    file.close();
+
+    const auto modified = ApplicationCache::stamp(path);
+    QCOMPARE(modified.size, stamp.size);
+    QVERIFY(modified.mtime != stamp.mtime);
+    QCOMPARE(cache.lookup("stamp", path, modified), nullopt);
+
+    // Other size
+    writeFile("stamp.desktop", app_entry + "# Comment\n");
+    QVERIFY(ApplicationCache::stamp(path).size != stamp.size);
+    QCOMPARE(cache.lookup("stamp", path, ApplicationCache::stamp(path)), nullopt);
+
+    // Reinserted records are valid again
+    const Application modified_app("stamp", path, po);
+    cache.insert(path, ApplicationCache::stamp(path), &modified_app);
+    const auto cached = cache.lookup("stamp", path, ApplicationCache::stamp(path));
+    QVERIFY(cached.has_value() && *cached);
+    QCOMPARE((*cached)->names(), modified_app.names());
+}
+
+void ApplicationsTests::cache_context_invalidation()
+{
+    const auto path = writeFile("context.desktop", app_entry);
+    const auto cache_path = dir.filePath("context.bin");
+    const auto stamp = ApplicationCache::stamp(path);
+    const Application app("context", path, po);
+
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        cache.insert(path, stamp, &app);
+        cache.save({path});
+    }
+
+    // Other options, locale or desktop environment drop all records
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(43);
+        QCOMPARE(cache.lookup("context", path, stamp), nullopt);
+        cache.save({path});
+    }
+
+    // Persistently
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        QCOMPARE(cache.lookup("context", path, stamp), nullopt);
+
+        cache.insert(path, stamp, &app);
+        QVERIFY(cache.lookup("context", path, stamp).has_value());
+
+        // Also within a run
+        cache.setContext(43);
+        QCOMPARE(cache.lookup("context", path, stamp), nullopt);
+    }
+
+    // Unreadable cache files are ignored
+    QFile file(cache_path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("garbage");
+    file.close();
+
+    ApplicationCache cache(cache_path);
+    cache.setContext(42);
+    QCOMPARE(cache.lookup("context", path, stamp), nullopt);
+}
+
+void ApplicationsTests::cache_vanished_paths()
+{
+    const auto a = writeFile("vanished-a.desktop", app_entry);
+    const auto b = writeFile("vanished-b.desktop", app_entry);
+    const auto cache_path = dir.filePath("vanished.bin");
+    const Application app_a("vanished-a", a, po), app_b("vanished-b", b, po);
+
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        cache.insert(a, ApplicationCache::stamp(a), &app_a);
+        cache.insert(b, ApplicationCache::stamp(b), &app_b);
+        cache.save({a, b});
+    }
+
+    const auto stamp_b = ApplicationCache::stamp(b);
+    QVERIFY(QFile::remove(b));
+
+    {
+        ApplicationCache cache(cache_path);
+        cache.setContext(42);
+        QVERIFY(cache.lookup("vanished-b", b, stamp_b).has_value());
+        cache.save({a});
+
+        // Dropped in memory
+        QCOMPARE(cache.lookup("vanished-b", b, stamp_b), nullopt);
+    }
+
+    // And on disk
+    ApplicationCache cache(cache_path);
+    cache.setContext(42);
+    QVERIFY(cache.lookup("vanished-a", a, ApplicationCache::stamp(a)).has_value());
+    QCOMPARE(cache.lookup("vanished-b", b, stamp_b), nullopt);
+}
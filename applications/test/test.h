@@ -0,0 +1,31 @@
+// Copyright (c) 2026 Manuel Schneider
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+class ApplicationsTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void parser_locale_fallback();
+    void parser_escapes();
+    void parser_groups();
+    void parser_duplicate_keys();
+    void parser_booleans();
+    void application_name();
+    void cache_round_trip();
+    void cache_stamp_invalidation();
+    void cache_context_invalidation();
+    void cache_vanished_paths();
+
+private:
+
+    QString writeFile(const QString &name, const QByteArray &content);
+
+    QTemporaryDir dir;
+
+};
@@ -0,0 +1,47 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "clipboarditem.h"
+#include "plugin.h"
+#include <QCoreApplication>
+#include <QLocale>
+#include <albert/albert.h>
+using namespace albert;
+using namespace std;
+
+ClipboardItem::ClipboardItem(Plugin *plugin, const QString &text,
+                             const QDateTime &datetime, size_t rank):
+    plugin_(plugin), text_(text), datetime_(datetime), rank_(rank) {}
+
+QString ClipboardItem::id() const { return plugin_->id(); }
+
+QString ClipboardItem::text() const { return text_; }
+
+QString ClipboardItem::subtext() const
+{ return QString("#%1 %2").arg(rank_).arg(QLocale().toString(datetime_, QLocale::LongFormat)); }
+
+QString ClipboardItem::inputActionText() const { return {}; }
+
+QStringList ClipboardItem::iconUrls() const { return {":clipboard"}; }
+
+vector<Action> ClipboardItem::actions() const
+{
+    // Translations live in the context of the plugin
+    static const auto tr_cp = QCoreApplication::translate("Plugin", "Copy and paste");
+    static const auto tr_c = QCoreApplication::translate("Plugin", "Copy");
+    static const auto tr_r = QCoreApplication::translate("Plugin", "Remove");
+    static const auto tr_s = QCoreApplication::translate("Plugin", "Save as snippet");
+
+    vector<Action> actions;
+
+    if (havePasteSupport())
+        actions.emplace_back("c", tr_cp, [t=text_]{ setClipboardTextAndPaste(t); });
+
+    actions.emplace_back("cp", tr_c, [t=text_]{ setClipboardText(t); });
+
+    actions.emplace_back("r", tr_r, [p=plugin_, t=text_]{ p->removeEntry(t); });
+
+    if (plugin_->haveSnippets())
+        actions.emplace_back("s", tr_s, [p=plugin_, t=text_]{ p->addSnippet(t); });
+
+    return actions;
+}
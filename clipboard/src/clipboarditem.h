@@ -0,0 +1,28 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QDateTime>
+#include <albert/item.h>
+class Plugin;
+
+// Actions are built on request, queries create items for matches only.
+class ClipboardItem : public albert::Item
+{
+public:
+
+    ClipboardItem(Plugin *plugin, const QString &text, const QDateTime &datetime, size_t rank);
+
+    QString id() const override;
+    QString text() const override;
+    QString subtext() const override;
+    QString inputActionText() const override;
+    QStringList iconUrls() const override;
+    std::vector<albert::Action> actions() const override;
+
+private:
+
+    Plugin * const plugin_;
+    const QString text_;
+    const QDateTime datetime_;
+    const size_t rank_;
+};
@@ -0,0 +1,198 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "history.h"
+#include <QRegularExpression>
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+const qsizetype History::MAX_INDEXED_LENGTH = 10000;
+static const size_t MIN_COMPACTION_SIZE = 1024;  // removed entries
+
+static inline size_t lowbit(size_t i) { return i & (~i + 1); }
+
+// Sum of the first k values of a Fenwick tree
+static size_t prefix(const vector<uint32_t> &tree, size_t k)
+{
+    size_t sum = 0;
+    for (; k > 0; k -= lowbit(k))
+        sum += tree[k];
+    return sum;
+}
+
+QStringList History::tokens(const QString &text)
+{
+    // https://en.wikipedia.org/wiki/Combining_Diacritical_Marks
+    static const QRegularExpression re_marks(R"([\x{0300}-\x{036f}])");
+    static const QRegularExpression re_separators(R"([^\p{L}\p{N}]+)");
+    return text.normalized(QString::NormalizationForm_D).remove(re_marks).toLower()
+        .split(re_separators, Qt::SkipEmptyParts);
+}
+
+void History::add(const QString &text, const QDateTime &datetime)
+{
+    remove(text);
+
+    const auto id = (uint32_t)entries_.size();
+    entries_.push_back({text, datetime});
+    ids_.emplace(text, id);
+
+    // Append to the tree, the new node sums the range it covers
+    if (fenwick_.empty())
+        fenwick_.emplace_back(0);
+    const auto j = fenwick_.size();
+    fenwick_.emplace_back((uint32_t)(1 + prefix(fenwick_, j - 1) - prefix(fenwick_, j - lowbit(j))));
+
+    if (text.size() > MAX_INDEXED_LENGTH)
+        unindexed_.emplace_back(id);
+    else
+    {
+        auto words = tokens(text);
+        words.removeDuplicates();
+        for (const auto &word : words)
+            tokens_[word].emplace_back(id);
+    }
+}
+
+bool History::remove(const QString &text)
+{
+    auto it = ids_.find(text);
+    if (it == ids_.end())
+        return false;
+
+    const auto id = it->second;
+    ids_.erase(it);
+    remove(id);
+
+    if (removed_ > MIN_COMPACTION_SIZE && removed_ > entries_.size() / 2)
+        compact();
+    return true;
+}
+
+void History::remove(uint32_t id)
+{
+    entries_[id] = {};
+    for (auto j = (size_t)id + 1; j < fenwick_.size(); j += lowbit(j))
+        --fenwick_[j];
+    ++removed_;
+}
+
+void History::truncate(size_t length)
+{
+    while (ids_.size() > length)
+    {
+        while (entries_[first_].text.isNull())
+            ++first_;
+        ids_.erase(entries_[first_].text);
+        remove(first_);
+    }
+
+    if (removed_ > MIN_COMPACTION_SIZE && removed_ > entries_.size() / 2)
+        compact();
+}
+
+size_t History::size() const { return ids_.size(); }
+
+size_t History::rank(uint32_t id) const { return ids_.size() - prefix(fenwick_, id); }
+
+void History::compact()
+{
+    // Renumber the live entries, the order and hence sorted id lists are kept
+    const auto none = numeric_limits<uint32_t>::max();
+    vector<uint32_t> ids(entries_.size(), none);
+    vector<Entry> entries;
+    entries.reserve(ids_.size());
+    for (uint32_t id = 0; id < entries_.size(); ++id)
+        if (!entries_[id].text.isNull())
+        {
+            ids[id] = (uint32_t)entries.size();
+            entries.emplace_back(::move(entries_[id]));
+        }
+
+    const auto remap = [&](vector<uint32_t> &list)
+    {
+        size_t size = 0;
+        for (auto id : list)
+            if (ids[id] != none)
+                list[size++] = ids[id];
+        list.resize(size);
+        list.shrink_to_fit();
+    };
+
+    for (auto it = tokens_.begin(); it != tokens_.end();)
+    {
+        remap(it->second);
+        if (it->second.empty())
+            it = tokens_.erase(it);
+        else
+            ++it;
+    }
+
+    remap(unindexed_);
+
+    for (auto &[text, id] : ids_)
+        id = ids[id];
+
+    entries_ = ::move(entries);
+
+    // All entries are live, build the tree bottom up
+    fenwick_.assign(entries_.size() + 1, 1);
+    fenwick_[0] = 0;
+    for (size_t j = 1; j < fenwick_.size(); ++j)
+        if (const auto parent = j + lowbit(j); parent < fenwick_.size())
+            fenwick_[parent] += fenwick_[j];
+
+    removed_ = 0;
+    first_ = 0;
+}
+
+void History::forEach(const Visitor &f) const
+{
+    size_t rank = 0;
+    for (auto id = entries_.size(); id-- > first_;)
+        if (const auto &entry = entries_[id]; !entry.text.isNull())
+            if (!f(entry, ++rank))
+                return;
+}
+
+void History::forEachCandidate(const QString &query, const Visitor &f) const
+{
+    const auto words = tokens(query);
+    if (words.isEmpty())
+        return forEach(f);
+
+    // Take the candidates of the most selective word. Ranges of short words may
+    // exceed the size of the history, a linear scan is cheaper then.
+    using It = decltype(tokens_)::const_iterator;
+    pair<It, It> range;
+    size_t min_count = ids_.size() / 2;
+    bool selective = false;
+    for (const auto &word : words)
+    {
+        size_t count = 0;
+        auto begin = tokens_.lower_bound(word), end = begin;
+        for (; end != tokens_.end() && end->first.startsWith(word) && count < min_count; ++end)
+            count += end->second.size();
+        if (count < min_count)
+        {
+            min_count = count;
+            range = {begin, end};
+            selective = true;
+        }
+    }
+
+    if (!selective)
+        return forEach(f);
+
+    vector<uint32_t> candidates(unindexed_);
+    candidates.reserve(candidates.size() + min_count);
+    for (auto it = range.first; it != range.second; ++it)
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+    sort(candidates.begin(), candidates.end(), greater<>());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    for (auto id : candidates)
+        if (const auto &entry = entries_[id]; !entry.text.isNull())
+            if (!f(entry, rank(id)))
+                return;
+}
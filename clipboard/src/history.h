@@ -0,0 +1,77 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+///
+/// Clipboard history
+///
+/// Entries are stored in insertion order and indexed by their text, such that
+/// duplicates are found in constant time. Removed entries leave holes, which are
+/// dropped on compaction. A Fenwick tree over the entries yields the rank of an
+/// entry, i.e. its position in the history, in logarithmic time.
+///
+/// A token index maps the normalized words of the texts to the ids of the entries
+/// containing them. Texts longer than MAX_INDEXED_LENGTH are not tokenized and
+/// always candidates.
+///
+/// Not thread-safe.
+///
+class History
+{
+public:
+
+    static const qsizetype MAX_INDEXED_LENGTH;
+
+    struct Entry
+    {
+        QString text;  // null if removed
+        QDateTime datetime;
+    };
+
+    using Visitor = std::function<bool(const Entry &entry, size_t rank)>;
+
+    /// Adds text as the most recent entry. An existing entry of text is removed.
+    void add(const QString &text, const QDateTime &datetime);
+
+    /// Removes the entry of text. @returns false if there is none.
+    bool remove(const QString &text);
+
+    /// Removes the oldest entries exceeding length
+    void truncate(size_t length);
+
+    size_t size() const;
+
+    /// Calls f for all entries, most recent first, until f returns false.
+    /// The rank is the 1-based position of the entry.
+    void forEach(const Visitor &f) const;
+
+    /// Calls f for the entries possibly matching the words of query, most recent first,
+    /// until f returns false. Candidates contain a word prefixed by one of the words of
+    /// the query and have to be verified by the caller.
+    void forEachCandidate(const QString &query, const Visitor &f) const;
+
+    /// @returns the lower case words of text, diacritics removed
+    static QStringList tokens(const QString &text);
+
+private:
+
+    void remove(uint32_t id);
+    size_t rank(uint32_t id) const;  // of a live entry
+    void compact();
+
+    std::vector<Entry> entries_;  // by id, ascending insertion order
+    std::unordered_map<QString, uint32_t> ids_;  // by text
+    std::map<QString, std::vector<uint32_t>> tokens_;  // sorted ids by token, includes removed
+    std::vector<uint32_t> unindexed_;  // sorted ids of untokenized texts, includes removed
+    std::vector<uint32_t> fenwick_;  // 1-based, sums of live entries
+    size_t removed_ = 0;
+    uint32_t first_ = 0;  // entries below are removed
+};
@@ -0,0 +1,371 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "historystore.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+#include <albert/logging.h>
+#include <algorithm>
+#include <vector>
+#if defined(Q_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+static const quint32 LOG_MAGIC = 0x434C4950;  // CLIP
+static const quint32 LOG_VERSION = 1;
+static const qint64 HEADER_SIZE = 8;
+static const size_t MIN_COMPACTION_SIZE = 1024;  // records
+
+static bool syncToDisk(QFileDevice &file)
+{
+    if (!file.flush())
+        return false;
+#if defined(Q_OS_WIN)
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+static int duplicateHandle(int handle)
+{
+#if defined(Q_OS_WIN)
+    return _dup(handle);
+#else
+    return dup(handle);
+#endif
+}
+
+static bool syncAndCloseHandle(int handle)
+{
+#if defined(Q_OS_WIN)
+    const auto synced = _commit(handle) == 0;
+    _close(handle);
+#else
+    const auto synced = fsync(handle) == 0;
+    close(handle);
+#endif
+    return synced;
+}
+
+static QByteArray header()
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << LOG_MAGIC << LOG_VERSION;
+    return data;
+}
+
+// Op, msecs since epoch, UTF-8 text, CRC-16 of the preceding fields
+static QByteArray record(quint8 op, const QString &text, const QDateTime &datetime)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << op << (qint64)datetime.toMSecsSinceEpoch() << text.toUtf8();
+    stream << qChecksum(data);
+    return data;
+}
+
+HistoryStore::HistoryStore(QString file_path) : file_path_(::move(file_path)) {}
+
+HistoryStore::~HistoryStore() { waitForSync(); }
+
+bool HistoryStore::open()
+{
+    file_.setFileName(file_path_);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        WARN << "Failed opening clipboard history log:" << file_.errorString();
+        return false;
+    }
+
+    loadable_size_ = file_.size();
+    loaded_records_ = 0;
+    appended_records_ = 0;
+    failed_compaction_records_ = 0;
+
+    {
+        lock_guard lock(sync_mutex_);
+        sync_pending_ = false;  // the handle pending, if any, is the previous log
+    }
+
+    if (loadable_size_ == 0)
+    {
+        if (file_.write(header()) != HEADER_SIZE || !file_.flush())
+            WARN << "Failed writing clipboard history log:" << file_.errorString();
+        else
+            requestSync();
+    }
+
+    return true;
+}
+
+void HistoryStore::close() { file_.close(); }
+
+bool HistoryStore::isOpen() const { return file_.isOpen(); }
+
+HistoryStore::Loaded HistoryStore::load(const bool &abort) const
+{
+    Loaded loaded;
+    if (loadable_size_ == 0)
+        return loaded;
+
+    QByteArray data;
+    if (QFile file(file_path_); file.open(QIODevice::ReadOnly))
+        data = file.read(loadable_size_);
+    else
+    {
+        WARN << "Failed reading clipboard history log:" << file.errorString();
+        return loaded;
+    }
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QDataStream stream(&buffer);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != LOG_MAGIC || version != LOG_VERSION)
+    {
+        WARN << "Clipboard history log has an invalid header. Discarding it.";
+        loaded.compact = true;
+        return loaded;
+    }
+
+    size_t records = 0;
+    while (!stream.atEnd() && !abort)
+    {
+        const auto begin = buffer.pos();
+        quint8 op;
+        qint64 msecs;
+        QByteArray text;
+        quint16 checksum;
+        stream >> op >> msecs >> text;
+        const auto end = buffer.pos();
+        stream >> checksum;
+
+        if (stream.status() != QDataStream::Ok
+            || checksum != qChecksum(QByteArrayView(data).sliced(begin, end - begin)))
+        {
+            WARN << QString("Clipboard history log is damaged at offset %1. "
+                            "Dropping %2 bytes.").arg(begin).arg(data.size() - begin);
+            loaded.compact = true;
+            break;
+        }
+
+        if (op == (quint8)Op::Add)
+            loaded.history.add(QString::fromUtf8(text), QDateTime::fromMSecsSinceEpoch(msecs));
+        else if (op == (quint8)Op::Remove)
+            loaded.history.remove(QString::fromUtf8(text));
+        ++records;
+    }
+
+    loaded.records = records;
+    return loaded;
+}
+
+// Stored most recent first
+void HistoryStore::loadLegacy(const QString &path, History &history)
+{
+    if (QFile file(path); file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        DEBG << "Reading clipboard history from" << file.fileName();
+        const auto arr = QJsonDocument::fromJson(file.readAll()).array();
+        for (auto it = arr.crbegin(); it != arr.crend(); ++it)
+        {
+            const auto object = it->toObject();
+            history.add(object["text"].toString(),
+                        QDateTime::fromSecsSinceEpoch(object["datetime"].toInt()));
+        }
+    }
+    else
+        WARN << "Failed reading from clipboard history:" << file.errorString();
+}
+
+void HistoryStore::setLoadedRecords(size_t records) { loaded_records_ = records; }
+
+void HistoryStore::append(Op op, const QString &text, const QDateTime &datetime)
+{
+    if (!file_.isOpen())
+        return;
+
+    if (compacting_)
+        appended_while_compacting_.push_back({op, text, datetime});
+
+    if (const auto data = record((quint8)op, text, datetime);
+        file_.write(data) != data.size() || !file_.flush())
+        WARN << "Failed writing clipboard history log:" << file_.errorString();
+    else
+    {
+        ++appended_records_;
+        requestSync();
+    }
+}
+
+void HistoryStore::requestSync()
+{
+    lock_guard lock(sync_mutex_);
+
+    // Records written meanwhile are covered by the pending sync
+    if (!sync_pending_)
+    {
+        const auto handle = duplicateHandle(file_.handle());
+        if (handle < 0)
+        {
+            WARN << "Failed syncing clipboard history log: Invalid handle.";
+            return;
+        }
+        sync_handles_.push_back(handle);
+        sync_pending_ = true;
+    }
+
+    if (!sync_running_)
+    {
+        sync_running_ = true;
+        sync_future_ = QtConcurrent::run([this]{ syncRecords(); });
+    }
+}
+
+void HistoryStore::syncRecords()
+{
+    for (;;)
+    {
+        vector<int> handles;
+        {
+            lock_guard lock(sync_mutex_);
+            if (sync_handles_.empty())
+            {
+                sync_running_ = false;
+                return;
+            }
+            handles = ::move(sync_handles_);
+            sync_handles_.clear();
+            sync_pending_ = false;
+        }
+
+        for (auto handle : handles)
+            if (!syncAndCloseHandle(handle))
+                WARN << "Failed syncing clipboard history log.";
+    }
+}
+
+void HistoryStore::waitForSync()
+{
+    unique_lock lock(sync_mutex_);
+    auto future = sync_future_;
+    lock.unlock();
+    future.waitForFinished();
+}
+
+void HistoryStore::appendAdd(const QString &text, const QDateTime &datetime)
+{ append(Op::Add, text, datetime); }
+
+void HistoryStore::appendRemove(const QString &text)
+{ append(Op::Remove, text, {}); }
+
+bool HistoryStore::needsCompaction(size_t live) const
+{
+    const auto records = loaded_records_ + appended_records_;
+    return !compacting_ && records > MIN_COMPACTION_SIZE && records > 2 * live
+           && records > 2 * failed_compaction_records_;
+}
+
+vector<History::Entry> HistoryStore::beginCompaction(const History &history)
+{
+    vector<History::Entry> entries;
+    entries.reserve(history.size());
+    history.forEach([&](const auto &entry, size_t){ entries.emplace_back(entry); return true; });
+    reverse(entries.begin(), entries.end());
+
+    compacting_ = true;
+    compacted_records_ = entries.size();
+    appended_while_compacting_.clear();
+    return entries;
+}
+
+bool HistoryStore::writeCompacted(const vector<History::Entry> &entries, const bool &abort)
+{
+    // Discarded unless committed by finishCompaction()
+    compacted_ = make_unique<QSaveFile>(file_path_);
+    auto &file = *compacted_;
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        WARN << "Failed compacting clipboard history log:" << file.errorString();
+        return false;
+    }
+
+    file.write(header());
+    for (const auto &entry : entries)
+        if (abort)
+            return false;
+        else
+            file.write(record((quint8)Op::Add, entry.text, entry.datetime));
+
+    // Such that the commit does not sync on the calling thread
+    if (!syncToDisk(file))
+    {
+        WARN << "Failed compacting clipboard history log:" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool HistoryStore::finishCompaction(bool written)
+{
+    compacting_ = false;
+    const auto appended = ::move(appended_while_compacting_);
+    appended_while_compacting_.clear();
+    const auto compacted = ::move(compacted_);
+
+    // Else the records are in the log already, or not needed since closed
+    if (!file_.isOpen())
+        return false;
+
+    if (written && compacted)
+    {
+        const auto records = loaded_records_ + appended_records_;
+        file_.close();
+        waitForSync();  // pending sync handles keep the log open
+        written = compacted->commit();
+        if (!written)
+            WARN << "Failed compacting clipboard history log:" << compacted->errorString();
+
+        if (!open())
+            return false;
+
+        if (written)
+        {
+            DEBG << "Compacted clipboard history log to" << compacted_records_ << "entries.";
+            loaded_records_ = compacted_records_;
+            for (const auto &r : appended)
+                append(r.op, r.text, r.datetime);
+            return true;
+        }
+
+        loaded_records_ = records;  // the old log, appended to meanwhile
+    }
+
+    // Back off, do not rewrite the log on every record
+    failed_compaction_records_ = loaded_records_ + appended_records_;
+    return false;
+}
+
+bool HistoryStore::isCompacting() const { return compacting_; }
+
+bool HistoryStore::compact(const History &history)
+{
+    const bool abort = false;
+    const auto written = writeCompacted(beginCompaction(history), abort);
+    return finishCompaction(written);
+}
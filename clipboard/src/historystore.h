@@ -0,0 +1,116 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include "history.h"
+#include <QFile>
+#include <QFuture>
+#include <QString>
+#include <memory>
+#include <mutex>
+#include <vector>
+class QSaveFile;
+
+///
+/// Append-only log of the clipboard history
+///
+/// Additions and removals are appended as checksummed records. Appended records
+/// are handed to the OS immediately and synced to disk on a background thread,
+/// bursts of records share a sync. Replaying the log restores the history. A torn
+/// record at the end, e.g. after a power loss, ends the replay. Compaction
+/// rewrites the log to the additions of the live entries.
+///
+/// The log is replayed as a whole. Old entries are not loaded lazily, since
+/// removals can only be applied by replaying the records in order and queries
+/// match all entries anyway. The replay runs on the loader, off the GUI thread.
+///
+/// load() and writeCompacted() may run on another thread than the other
+/// functions. load() reads the records present at the time of open() only,
+/// writeCompacted() writes aside and touches the compacted log only.
+///
+class HistoryStore
+{
+public:
+
+    explicit HistoryStore(QString file_path);
+    ~HistoryStore();
+
+    struct Loaded
+    {
+        History history;
+        size_t records = 0;  // replayed, see setLoadedRecords()
+        bool compact = false;  // the log is damaged or outdated
+    };
+
+    /// Opens the log for appending, creates it if it does not exist
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    /// Replays the records present at the time of open()
+    Loaded load(const bool &abort) const;
+
+    /// Reads the JSON history of former versions into history
+    static void loadLegacy(const QString &path, History &history);
+
+    /// Accounts the records replayed by load() in needsCompaction()
+    void setLoadedRecords(size_t records);
+
+    void appendAdd(const QString &text, const QDateTime &datetime);
+    void appendRemove(const QString &text);
+
+    /// @returns true if the log has grown considerably beyond live entries and is not
+    /// being compacted. After a failed compaction the log has to double first.
+    bool needsCompaction(size_t live) const;
+
+    /// Compaction in three steps, such that the log can be written on another thread.
+    /// Records appended meanwhile are kept aside and appended to the compacted log.
+    /// @returns the entries of history, oldest first
+    std::vector<History::Entry> beginCompaction(const History &history);
+
+    /// Writes the compacted log aside and syncs it to disk. @returns false on failure.
+    bool writeCompacted(const std::vector<History::Entry> &entries, const bool &abort);
+
+    /// Replaces the log by the compacted one, if written and open, and appends the records
+    /// kept aside. The log is closed meanwhile, open files can not be replaced on Windows.
+    /// @returns true if the log has been replaced
+    bool finishCompaction(bool written);
+
+    bool isCompacting() const;
+
+    /// Rewrites the log to the entries of history. @returns false on failure.
+    bool compact(const History &history);
+
+private:
+
+    enum class Op : quint8 { Add = 1, Remove = 2 };
+
+    struct Record
+    {
+        Op op;
+        QString text;
+        QDateTime datetime;
+    };
+
+    void append(Op op, const QString &text, const QDateTime &datetime);
+    void requestSync();
+    void syncRecords();
+    void waitForSync();
+
+    const QString file_path_;
+    QFile file_;  // opened for appending
+    qint64 loadable_size_ = 0;  // size at open()
+    size_t loaded_records_ = 0;  // see setLoadedRecords()
+    size_t appended_records_ = 0;
+    bool compacting_ = false;
+    size_t compacted_records_ = 0;
+    size_t failed_compaction_records_ = 0;  // records at the last failed compaction
+    std::vector<Record> appended_while_compacting_;
+    std::unique_ptr<QSaveFile> compacted_;  // written by writeCompacted()
+
+    std::mutex sync_mutex_;  // guards the sync_ members
+    std::vector<int> sync_handles_;  // duplicates, the log may be closed meanwhile
+    bool sync_pending_ = false;  // the open log has a handle in sync_handles_
+    bool sync_running_ = false;
+    QFuture<void> sync_future_;
+
+};
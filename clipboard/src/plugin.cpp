@@ -1,40 +1,41 @@
 // Copyright (c) 2022-2025 Manuel Schneider
 
+#include "clipboarditem.h"
 #include "plugin.h"
 #include <QCheckBox>
 #include <QDir>
 #include <QFile>
 #include <QFormLayout>
 #include <QGuiApplication>
-#include <QJsonArray>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonValue>
 #include <QMessageBox>
 #include <QSettings>
 #include <QSpinBox>
+#include <QStandardPaths>
 #include <albert/albert.h>
 #include <albert/extensionregistry.h>
 #include <albert/logging.h>
 #include <albert/matcher.h>
 #include <albert/plugin/snippets.h>
-#include <albert/standarditem.h>
 #include <shared_mutex>
 ALBERT_LOGGING_CATEGORY("clipboard")
 using namespace albert;
 using namespace std;
 
 namespace {
-static const char* HISTORY_FILE_NAME = "clipboard_history";
+static const char* HISTORY_FILE_NAME = "clipboard_history.log";
+static const char* LEGACY_HISTORY_FILE_NAME = "clipboard_history";  // JSON
 static const char* CFG_PERSISTENCE = "persistent";
 static const bool DEF_PERSISTENCE = false;
 static const char* CFG_HISTORY_LENGTH = "history_length";
 static const uint DEF_HISTORY_LENGTH = 100;
+static const int POLL_INTERVAL = 500;  // ms
+static const size_t MAX_RESULTS = 1000;
+static const size_t BATCH_SIZE = 50;  // results added to the query at once
 }
 
-
 Plugin::Plugin():
-    clipboard(QGuiApplication::clipboard())
+    clipboard(QGuiApplication::clipboard()),
+    store(QDir(dataLocation()).filePath(HISTORY_FILE_NAME))
 {
     // Load settings
 
@@ -43,62 +44,133 @@ Plugin::Plugin():
     length = s->value(CFG_HISTORY_LENGTH, DEF_HISTORY_LENGTH).toUInt();
 
 
-    // Load history, if configured
+    // Load history in the background, if configured
 
-    if (persistent)
+    loader.parallel = [this, legacy = QDir(dataLocation()).filePath(LEGACY_HISTORY_FILE_NAME)]
+        (const bool &abort)
     {
-        if (QFile file(QDir(dataLocation()).filePath(HISTORY_FILE_NAME));
-            file.open(QIODevice::ReadOnly | QIODevice::Text))
+        auto result = store.load(abort);
+        if (result.history.size() == 0 && QFile::exists(legacy))
         {
-            DEBG << "Reading clipboard history from" << file.fileName();
-            const auto arr = QJsonDocument::fromJson(file.readAll()).array();
-            for (const auto &value : arr)
-            {
-                const auto object = value.toObject();
-                history.emplace_back(object["text"].toString(),
-                                     QDateTime::fromSecsSinceEpoch(object["datetime"].toInt()));
-            }
-            file.close();
+            HistoryStore::loadLegacy(legacy, result.history);
+            result.compact = true;
         }
-        else
-            DEBG << "Failed reading from clipboard history.";
-    }
+        return result;
+    };
 
+    loader.finish = [this](HistoryStore::Loaded &&result){ mergeHistory(::move(result)); };
 
-    // Init clipboard pull timer
+    compactor.parallel = [this](const bool &abort)
+    { return store.writeCompacted(compaction_snapshot, abort); };
 
-    timer.start(500);
-    connect(&timer, &QTimer::timeout, this, &Plugin::checkClipboard);
+    compactor.finish = [this](bool &&written){ finishCompaction(written); };
+
+    if (persistent)
+        loadHistory();
+
+
+    watchClipboard();
 }
 
 Plugin::~Plugin()
 {
-    if (persistent)
+    if (wl_paste.state() != QProcess::NotRunning)
     {
-        QJsonArray array;
-        for (const auto &entry : history)
-        {
-            QJsonObject object;
-            object["text"] = entry.text;
-            object["datetime"] = entry.datetime.toSecsSinceEpoch();
-            array.append(object);
-        }
+        wl_paste.disconnect(this);
+        wl_paste.kill();
+        wl_paste.waitForFinished();
+    }
+}
 
-        QDir data_dir = dataLocation();
-        if (data_dir.exists() || data_dir.mkpath("."))
-        {
-            if (QFile file(data_dir.filePath(HISTORY_FILE_NAME));
-                file.open(QIODevice::WriteOnly))
-            {
-                DEBG << "Writing clipboard history to" << file.fileName();
-                file.write(QJsonDocument(array).toJson());
-                file.close();
-            }
-            else
-                WARN << "Failed creating history file:" << data_dir.path();
-        }
-        else
-            WARN << "Failed creating data dir" << data_dir.path();
+void Plugin::loadHistory()
+{
+    // The loader reads the log of open(), reopened once merged
+    if (loading)
+    {
+        compaction_pending = true;  // entries added while not persistent are not logged
+        return;
+    }
+
+    tryCreateDirectory(dataLocation());
+    if (!store.open())
+        return;
+
+    if (!loaded)
+    {
+        compaction_pending = history.size() > 0;  // likewise
+        loading = true;
+        loader.run();
+    }
+    else
+        compactHistory();
+}
+
+void Plugin::mergeHistory(HistoryStore::Loaded &&result)
+{
+    lock_guard lock(mutex);
+
+    // Removals and additions while loading are more recent
+    for (const auto &text : removed_while_loading)
+        result.history.remove(text);
+    removed_while_loading.clear();
+
+    vector<const History::Entry*> recent;
+    history.forEach([&](const auto &entry, size_t){ recent.emplace_back(&entry); return true; });
+    for (auto it = recent.rbegin(); it != recent.rend(); ++it)
+        result.history.add((*it)->text, (*it)->datetime);
+
+    history = ::move(result.history);
+    history.truncate(length);
+    loading = false;
+    loaded = true;
+
+    DEBG << QString("Loaded %1 clipboard history entries [%2 ms]")
+                .arg(history.size()).arg(loader.runtime.count());
+
+    if (persistent && !store.isOpen() && !store.open())
+        return;
+    store.setLoadedRecords(result.records);
+
+    const bool compact = result.compact || compaction_pending;
+    compaction_pending = false;
+    if (compact || store.needsCompaction(history.size()))
+        compactHistory();
+}
+
+void Plugin::compactHistory()
+{
+    if (!persistent || loading)
+        return;
+
+    if (store.isCompacting())
+    {
+        compaction_pending = true;  // the snapshot is outdated
+        return;
+    }
+
+    // Written on the compactor from a snapshot, records appended meanwhile are kept aside
+    compaction_snapshot = store.beginCompaction(history);
+    compactor.run();
+}
+
+void Plugin::finishCompaction(bool written)
+{
+    lock_guard lock(mutex);
+
+    compaction_snapshot.clear();
+    const auto compacted = store.finishCompaction(written);
+
+    DEBG << QString("Compacted clipboard history [%1 ms]").arg(compactor.runtime.count());
+
+    // The legacy history is migrated once compacted
+    if (const auto legacy = QDir(dataLocation()).filePath(LEGACY_HISTORY_FILE_NAME);
+        compacted && QFile::exists(legacy))
+        QFile::remove(legacy);
+
+    if (compaction_pending)
+    {
+        compaction_pending = false;
+        compactHistory();
     }
 }
 
@@ -106,66 +178,48 @@ QString Plugin::defaultTrigger() const { return " "; }
 
 void Plugin::handleTriggerQuery(Query &query)
 {
-    QLocale loc;
-    int rank = 0;
     Matcher matcher(query.string());
     vector<shared_ptr<Item>> items;
+    size_t count = 0;
 
     shared_lock l(mutex);
 
-    for (const auto &entry : history)
+    // Candidates are visited in rank order, added in batches
+    history.forEachCandidate(query.string(), [&](const auto &entry, size_t rank)
     {
-        ++rank;
         if (matcher.match(entry.text))
         {
-            static const auto tr_cp = tr("Copy and paste");
-            static const auto tr_c = tr("Copy");
-            static const auto tr_r = tr("Remove");
-
-            vector<Action> actions;
-
-            if(havePasteSupport())
-                actions.emplace_back(
-                    "c", tr_cp,
-                    [t=entry.text](){ setClipboardTextAndPaste(t); }
-                );
-
-            actions.emplace_back(
-                "cp", tr_c,
-                [t=entry.text](){ setClipboardText(t); }
-            );
-
-            actions.emplace_back(
-                "r", tr_r,
-                [this, t=entry.text]()
-                {
-                    lock_guard lock(mutex);
-                    this->history.remove_if([t](const auto& ce){ return ce.text == t; });
-                }
-            );
-
-            if (snippets)
-                actions.emplace_back(
-                    "s", tr("Save as snippet"),
-                    [this, t=entry.text]()
-                    {
-                        snippets->addSnippet(t);
-                    });
-
-            items.push_back(StandardItem::make(
-                    id(),
-                    entry.text,
-                    QString("#%1 %2").arg(rank).arg(loc.toString(entry.datetime, QLocale::LongFormat)),
-                    {":clipboard"},
-                    ::move(actions)
-                )
-            );
+            items.emplace_back(make_shared<ClipboardItem>(this, entry.text, entry.datetime, rank));
+            if (++count % BATCH_SIZE == 0)
+            {
+                query.add(items);
+                items.clear();
+            }
         }
-    }
+        return count < MAX_RESULTS && query.isValid();
+    });
 
     query.add(items);
 }
 
+void Plugin::removeEntry(const QString &text)
+{
+    lock_guard lock(mutex);
+    history.remove(text);
+    if (loading)
+        removed_while_loading.emplace_back(text);
+    if (persistent)
+        store.appendRemove(text);
+}
+
+bool Plugin::haveSnippets() { return static_cast<bool>(snippets); }
+
+void Plugin::addSnippet(const QString &text)
+{
+    if (snippets)
+        snippets->addSnippet(text);
+}
+
 QWidget *Plugin::buildConfigWidget()
 {
     auto *w = new QWidget;
@@ -176,7 +230,15 @@ QWidget *Plugin::buildConfigWidget()
     c->setToolTip(tr("Stores the history on disk so that it persists across restarts."));
     l->addRow(tr("Store history"), c);
     connect(c, &QCheckBox::toggled, this, [this](bool checked)
-            { settings()->setValue(CFG_PERSISTENCE, persistent = checked); });
+            {
+                settings()->setValue(CFG_PERSISTENCE, persistent = checked);
+
+                lock_guard lock(mutex);
+                if (persistent)
+                    loadHistory();
+                else
+                    store.close();
+            });
 
     auto *s = new QSpinBox;
     s->setMinimum(1);
@@ -188,34 +250,103 @@ QWidget *Plugin::buildConfigWidget()
                 settings()->setValue(CFG_HISTORY_LENGTH, length = value);
 
                 lock_guard lock(mutex);
-                if (length < history.size())
-                    history.resize(length);
+                history.truncate(length);
+                if (store.needsCompaction(history.size()))
+                    compactHistory();
             });
 
     w->setLayout(l);
     return w;
 }
 
-void Plugin::checkClipboard()
+void Plugin::watchClipboard()
+{
+    connect(&timer, &QTimer::timeout, this, &Plugin::checkClipboard);
+
+    // Wayland clients get selection events only while focused. wl-paste uses the data
+    // control protocol of the compositor, if supported.
+    if (QGuiApplication::platformName().startsWith(QStringLiteral("wayland")))
+    {
+        if (const auto path = QStandardPaths::findExecutable("wl-paste"); !path.isEmpty())
+            watchWaylandClipboard(path);
+        else
+        {
+            WARN << "wl-paste not found. Polling the clipboard.";
+            timer.start(POLL_INTERVAL);
+        }
+    }
+
+#if defined(Q_OS_MACOS)
+    // Changes by other applications are detected only on activation
+    else
+        timer.start(POLL_INTERVAL);
+#else
+    // X11 (XFixes selection notifications) and Windows
+    else
+        connect(clipboard, &QClipboard::dataChanged, this, &Plugin::checkClipboard);
+#endif
+
+    checkClipboard();
+}
+
+void Plugin::watchWaylandClipboard(const QString &path)
+{
+    // wl-paste runs the command on every selection change, passing the text to its
+    // stdin. Texts are terminated by a null character, which text does not contain.
+    connect(&wl_paste, &QProcess::readyReadStandardOutput, this, [this]
+    {
+        wl_paste_buffer.append(wl_paste.readAllStandardOutput());
+        for (qsizetype end; (end = wl_paste_buffer.indexOf('\0')) >= 0;)
+        {
+            addText(QString::fromUtf8(wl_paste_buffer.first(end)));
+            wl_paste_buffer.remove(0, end + 1);
+        }
+    });
+
+    connect(&wl_paste, &QProcess::finished, this, [this]
+    {
+        WARN << "wl-paste exited:" << wl_paste.readAllStandardError().trimmed()
+             << "Polling the clipboard.";
+        timer.start(POLL_INTERVAL);
+    });
+
+    connect(&wl_paste, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error)
+    {
+        if (error == QProcess::FailedToStart)
+        {
+            WARN << "Failed starting wl-paste:" << wl_paste.errorString() << "Polling the clipboard.";
+            timer.start(POLL_INTERVAL);
+        }
+    });
+
+    DEBG << "Watching the clipboard using" << path;
+    wl_paste.start(path, {"--type", "text", "--watch", "sh", "-c", "cat; printf '\\0'"});
+}
+
+void Plugin::checkClipboard() { addText(clipboard->text()); }
+
+void Plugin::addText(const QString &text)
 {
     // skip empty text (images, pixmaps etc), spaces only or no change
-    if (auto text = clipboard->text();
-        text.trimmed().isEmpty() || text == clipboard_text )
+    if (const auto hash = qHash(text);
+        hash == clipboard_hash || text.trimmed().isEmpty())
         return;
     else
-        clipboard_text = text;
+        clipboard_hash = hash;
 
     lock_guard lock(mutex);
 
-    // remove dups
-    history.erase(remove_if(history.begin(), history.end(),
-                            [this](const auto &ce) { return ce.text == clipboard_text; }),
-                  history.end());
+    // add an entry, replaces dups
+    const auto datetime = QDateTime::currentDateTime();
+    history.add(text, datetime);
 
-    // add an entry
-    history.emplace_front(clipboard_text, QDateTime::currentDateTime());
+    // adjust length
+    history.truncate(length);
 
-    // adjust lenght
-    if (length < history.size())
-        history.resize(length);
+    if (persistent)
+    {
+        store.appendAdd(text, datetime);
+        if (store.needsCompaction(history.size()))
+            compactHistory();
+    }
 }
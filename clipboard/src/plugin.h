@@ -1,9 +1,13 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
 #pragma once
+#include "history.h"
+#include "historystore.h"
 #include <QClipboard>
 #include <QDateTime>
+#include <QProcess>
 #include <QTimer>
+#include <albert/backgroundexecutor.h>
 #include <albert/extensionplugin.h>
 #include <albert/plugin/snippets.h>
 #include <albert/plugindependency.h>
@@ -11,17 +15,6 @@
 #include <shared_mutex>
 
 
-struct ClipboardEntry
-{
-    // required to allow list<ClipboardEntry>::resize
-    // actually never used.
-    ClipboardEntry() = default;
-    ClipboardEntry(QString t, QDateTime dt) : text(std::move(t)), datetime(dt) {}
-    QString text;
-    QDateTime datetime;
-};
-
-
 class Plugin : public albert::ExtensionPlugin,
                public albert::TriggerQueryHandler
 {
@@ -36,17 +29,38 @@ public:
     void handleTriggerQuery(albert::Query &) override;
     QWidget *buildConfigWidget() override;
 
+    void removeEntry(const QString &text);
+    bool haveSnippets();
+    void addSnippet(const QString &text);
+
 private:
+    void watchClipboard();
+    void watchWaylandClipboard(const QString &wl_paste);
     void checkClipboard();
+    void addText(const QString &text);
+    void loadHistory();
+    void mergeHistory(HistoryStore::Loaded &&loaded);
+    void compactHistory();
+    void finishCompaction(bool written);
 
-    QTimer timer;
+    QTimer timer;  // polling fallback
+    QProcess wl_paste;  // notifies on Wayland, where Qt does not while unfocused
+    QByteArray wl_paste_buffer;
     QClipboard * const clipboard;
     uint length;
-    std::list<ClipboardEntry> history;
+    History history;
     bool persistent;
+    HistoryStore store;
+    albert::BackgroundExecutor<HistoryStore::Loaded> loader;
+    bool loading = false;  // the history of the store is not merged yet
+    bool loaded = false;
+    bool compaction_pending = false;  // once loaded or compacted
+    std::vector<History::Entry> compaction_snapshot;  // read by the compactor while running
+    albert::BackgroundExecutor<bool> compactor;  // destroyed first
+    std::vector<QString> removed_while_loading;
     std::shared_mutex mutex;
-    // explicit current, such that users can delete recent ones
-    QString clipboard_text;
+    // hash of the explicit current, such that users can delete recent ones
+    size_t clipboard_hash = 0;
     
     albert::WeakDependency<snippets::Plugin> snippets{"snippets"};
 };
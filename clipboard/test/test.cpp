@@ -0,0 +1,467 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "history.h"
+#include "historystore.h"
+#include "test.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <albert/matcher.h>
+#include <set>
+using namespace albert;
+using namespace std;
+
+
+QTEST_APPLESS_MAIN(ClipboardTests)
+
+
+// Texts of history, most recent first. Unexpected ranks are appended, failing comparisons.
+static QStringList texts(const History &history)
+{
+    QStringList texts;
+    history.forEach([&](const auto &entry, size_t rank)
+    {
+        texts << entry.text;
+        if (rank != (size_t)texts.size())
+            texts << QString("rank %1").arg(rank);
+        return true;
+    });
+    return texts;
+}
+
+static HistoryStore::Loaded reload(const QString &path)
+{
+    HistoryStore store(path);
+    if (!store.open())
+        return {};
+    const bool abort = false;
+    return store.load(abort);
+}
+
+void ClipboardTests::history_add_remove()
+{
+    const auto dt = QDateTime::currentDateTime();
+    History history;
+
+    history.add("a", dt);
+    history.add("b", dt.addSecs(1));
+    history.add("c", dt.addSecs(2));
+    QCOMPARE(history.size(), 3);
+    QCOMPARE(texts(history), QStringList({"c", "b", "a"}));
+
+    // Duplicates replace the former entry
+    history.add("a", dt.addSecs(3));
+    QCOMPARE(history.size(), 3);
+    QCOMPARE(texts(history), QStringList({"a", "c", "b"}));
+
+    QDateTime datetime;
+    history.forEach([&](const auto &entry, size_t){ datetime = entry.datetime; return false; });
+    QCOMPARE(datetime, dt.addSecs(3));
+
+    QVERIFY(history.remove("c"));
+    QVERIFY(!history.remove("c"));
+    QVERIFY(!history.remove("x"));
+    QCOMPARE(history.size(), 2);
+    QCOMPARE(texts(history), QStringList({"a", "b"}));
+
+    QVERIFY(history.remove("a"));
+    QVERIFY(history.remove("b"));
+    QCOMPARE(history.size(), 0);
+    QVERIFY(texts(history).isEmpty());
+
+    // Removed texts can be added again
+    history.add("b", dt);
+    QCOMPARE(texts(history), QStringList({"b"}));
+}
+
+void ClipboardTests::history_truncate()
+{
+    const auto dt = QDateTime::currentDateTime();
+    History history;
+
+    for (int i = 0; i < 3000; ++i)
+        history.add(QString("entry %1").arg(i), dt);
+
+    // Removes more than half of the entries, which compacts the history
+    history.truncate(1000);
+    QCOMPARE(history.size(), 1000);
+
+    auto t = texts(history);
+    QCOMPARE(t.size(), 1000);
+    QCOMPARE(t.first(), "entry 2999");
+    QCOMPARE(t.last(), "entry 2000");
+
+    // Removals and additions after compaction
+    QVERIFY(!history.remove("entry 1999"));
+    QVERIFY(history.remove("entry 2500"));
+    history.add("entry 2000", dt);
+    for (int i = 3000; i < 3500; ++i)
+        history.add(QString("entry %1").arg(i), dt);
+
+    history.truncate(1000);
+    QCOMPARE(history.size(), 1000);
+
+    t = texts(history);
+    QCOMPARE(t.size(), 1000);
+    QCOMPARE(t.first(), "entry 3499");
+    QCOMPARE(t.at(500), "entry 2000");
+    QCOMPARE(t.last(), "entry 2501");
+    QVERIFY(!t.contains("entry 2500"));
+
+    // The token index follows the renumbered entries
+    vector<pair<QString, size_t>> candidates;
+    history.forEachCandidate("2000", [&](const auto &entry, size_t rank)
+    { candidates.emplace_back(entry.text, rank); return true; });
+    QCOMPARE(candidates.size(), 1);
+    QCOMPARE(candidates[0].first, "entry 2000");
+    QCOMPARE(candidates[0].second, 501);
+
+    history.truncate(0);
+    QCOMPARE(history.size(), 0);
+    QVERIFY(texts(history).isEmpty());
+}
+
+void ClipboardTests::history_rank()
+{
+    const auto dt = QDateTime::currentDateTime();
+    History history;
+
+    for (int i = 0; i < 10; ++i)
+        history.add(QString("e%1").arg(i), dt);
+
+    QVERIFY(history.remove("e8"));
+    QVERIFY(history.remove("e5"));
+    QVERIFY(history.remove("e0"));
+    history.add("e2", dt);
+
+    const QStringList expected{"e2", "e9", "e7", "e6", "e4", "e3", "e1"};
+    QCOMPARE(texts(history), expected);
+
+    // Ranks of candidates match the positions in the history
+    for (const auto &text : expected)
+    {
+        vector<pair<QString, size_t>> candidates;
+        history.forEachCandidate(text, [&](const auto &entry, size_t rank)
+        { candidates.emplace_back(entry.text, rank); return true; });
+        QCOMPARE(candidates.size(), 1);
+        QCOMPARE(candidates[0].first, text);
+        QCOMPARE(candidates[0].second, (size_t)expected.indexOf(text) + 1);
+    }
+}
+
+void ClipboardTests::history_candidates()
+{
+    const auto dt = QDateTime::currentDateTime();
+    History history;
+
+    const QStringList texts{
+        "Hello World",
+        "hello-world.txt",
+        "Crème brûlée",
+        "CREME FRAICHE",
+        "https://albertlauncher.github.io/",
+        "foo_bar baz",
+        "the quick brown fox",
+        "x",
+        QString("long ") + QString("word ").repeated(History::MAX_INDEXED_LENGTH / 4),
+        "",
+    };
+    for (const auto &text : texts)
+        if (!text.isEmpty())
+            history.add(text, dt);
+
+    // Filler, such that prefixes are selective
+    for (int i = 0; i < 100; ++i)
+        history.add(QString("filler %1").arg(i), dt);
+
+    const QStringList queries{
+        "hello", "HELLO WOR", "world hello", "wor", "creme", "crème", "brulee", "fra",
+        "github", "albert", "foo", "bar", "qu fox", "x", "long", "word", "fil", "filler 42",
+        "nothing", "", " ", "o",
+    };
+
+    for (const auto &query : queries)
+    {
+        Matcher matcher(query);
+
+        set<QString> matches;
+        history.forEach([&](const auto &entry, size_t)
+        {
+            if (matcher.match(entry.text))
+                matches.emplace(entry.text);
+            return true;
+        });
+
+        set<QString> candidates;
+        history.forEachCandidate(query, [&](const auto &entry, size_t)
+        { candidates.emplace(entry.text); return true; });
+
+        for (const auto &match : matches)
+            if (candidates.count(match) == 0)
+                QFAIL(qPrintable(QString("'%1' matches '%2' but is no candidate")
+                                     .arg(query, match.left(32))));
+    }
+
+    // Selective queries do not visit everything
+    size_t count = 0;
+    history.forEachCandidate("brulee", [&](const auto &, size_t){ ++count; return true; });
+    QVERIFY(count < history.size());
+}
+
+void ClipboardTests::store_replay()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("log");
+    const auto dt = QDateTime::fromMSecsSinceEpoch(1700000000123);
+
+    // A new log is empty
+    auto loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(loaded.records, 0);
+    QCOMPARE(loaded.history.size(), 0);
+
+    {
+        HistoryStore store(path);
+        QVERIFY(store.open());
+        store.appendAdd("a", dt);
+        store.appendAdd("b", dt.addMSecs(1));
+        store.appendAdd("c", dt.addMSecs(2));
+        store.appendRemove("b");
+        store.appendAdd("a", dt.addMSecs(3));
+        store.appendAdd("ünïcödé\n", dt.addMSecs(4));
+    }
+
+    loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(loaded.records, 6);
+    QCOMPARE(texts(loaded.history), QStringList({"ünïcödé\n", "a", "c"}));
+
+    vector<QDateTime> datetimes;
+    loaded.history.forEach([&](const auto &entry, size_t)
+    { datetimes.emplace_back(entry.datetime); return true; });
+    QCOMPARE(datetimes, vector<QDateTime>({dt.addMSecs(4), dt.addMSecs(3), dt.addMSecs(2)}));
+
+    // Loads the records present at open() only
+    HistoryStore store(path);
+    QVERIFY(store.open());
+    store.appendAdd("d", dt);
+    const bool abort = false;
+    loaded = store.load(abort);
+    QCOMPARE(loaded.records, 6);
+    QCOMPARE(reload(path).records, 7);
+}
+
+void ClipboardTests::store_torn_tail()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("log");
+    const auto dt = QDateTime::currentDateTime();
+
+    {
+        HistoryStore store(path);
+        QVERIFY(store.open());
+        store.appendAdd("a", dt);
+        store.appendAdd("b", dt);
+        store.appendAdd("c", dt);
+    }
+
+    // E.g. a crash while writing the last record
+    QVERIFY(QFile::resize(path, QFileInfo(path).size() - 3));
+
+    auto loaded = reload(path);
+    QVERIFY(loaded.compact);
+    QCOMPARE(loaded.records, 2);
+    QCOMPARE(texts(loaded.history), QStringList({"b", "a"}));
+
+    // Appending after compaction, else records behind the torn one were lost
+    {
+        HistoryStore store(path);
+        QVERIFY(store.open());
+        QVERIFY(store.compact(loaded.history));
+        store.appendAdd("d", dt);
+    }
+
+    loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(texts(loaded.history), QStringList({"d", "b", "a"}));
+}
+
+void ClipboardTests::store_checksum_mismatch()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("log");
+    const auto dt = QDateTime::currentDateTime();
+
+    {
+        HistoryStore store(path);
+        QVERIFY(store.open());
+        store.appendAdd("first", dt);
+        store.appendAdd("second", dt);
+        store.appendAdd("third", dt);
+    }
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    auto data = file.readAll();
+    const auto i = data.indexOf("second");
+    QVERIFY(i > 0);
+    data[i] = 'S';
+    QVERIFY(file.seek(0));
+    QCOMPARE(file.write(data), data.size());
+    file.close();
+
+    // The replay ends at the damaged record
+    auto loaded = reload(path);
+    QVERIFY(loaded.compact);
+    QCOMPARE(loaded.records, 1);
+    QCOMPARE(texts(loaded.history), QStringList({"first"}));
+
+    // Invalid header
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("garbage, not a log");
+    file.close();
+
+    loaded = reload(path);
+    QVERIFY(loaded.compact);
+    QCOMPARE(loaded.records, 0);
+    QCOMPARE(loaded.history.size(), 0);
+}
+
+void ClipboardTests::store_compaction()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto path = dir.filePath("log");
+    const auto dt = QDateTime::fromMSecsSinceEpoch(1700000000123);
+
+    HistoryStore store(path);
+    QVERIFY(store.open());
+
+    History history;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const auto text = QString::number(i % 100);
+        history.add(text, dt.addMSecs(i));
+        store.appendAdd(text, dt.addMSecs(i));
+    }
+    QVERIFY(store.needsCompaction(history.size()));
+
+    const auto size = QFileInfo(path).size();
+    QVERIFY(store.compact(history));
+    QVERIFY(!store.needsCompaction(history.size()));
+    QVERIFY(QFileInfo(path).size() < size / 10);
+
+    // Appends to the compacted log
+    history.add("after", dt);
+    store.appendAdd("after", dt);
+
+    auto loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(loaded.records, 101);
+    QCOMPARE(texts(loaded.history), texts(history));
+
+    // Stepwise, as on the compactor. Records appended meanwhile are kept aside.
+    const auto entries = store.beginCompaction(history);
+    QCOMPARE(entries.size(), 101);
+    QCOMPARE(entries.front().text, "0");  // oldest first
+    QCOMPARE(entries.back().text, "after");
+    QVERIFY(store.isCompacting());
+    QVERIFY(!store.needsCompaction(0));
+
+    history.add("during", dt);
+    store.appendAdd("during", dt);
+    history.remove("5");
+    store.appendRemove("5");
+
+    bool abort = false;
+    QVERIFY(store.writeCompacted(entries, abort));
+
+    history.add("between", dt);
+    store.appendAdd("between", dt);  // to the replaced log
+
+    QVERIFY(store.finishCompaction(true));
+    QVERIFY(!store.isCompacting());
+
+    loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(loaded.records, 104);
+    QCOMPARE(texts(loaded.history), texts(history));
+
+    // Aborted compactions keep the log
+    const auto aborted_entries = store.beginCompaction(history);
+    history.add("aborted", dt);
+    store.appendAdd("aborted", dt);
+    abort = true;
+    QVERIFY(!store.writeCompacted(aborted_entries, abort));
+    QVERIFY(!store.finishCompaction(false));
+
+    loaded = reload(path);
+    QCOMPARE(loaded.records, 105);
+    QCOMPARE(texts(loaded.history), texts(history));
+
+    // Failed compactions back off until the log has doubled
+    history.add("backoff", dt);
+    for (int i = 0; i < 1100; ++i)
+        store.appendAdd("backoff", dt);
+    QVERIFY(store.needsCompaction(history.size()));
+    QVERIFY(!store.writeCompacted(store.beginCompaction(history), abort));
+    QVERIFY(!store.finishCompaction(false));
+    QVERIFY(!store.needsCompaction(history.size()));
+
+    for (int i = 0; i < 1206; ++i)
+        store.appendAdd("backoff", dt);
+    QVERIFY(store.needsCompaction(history.size()));
+    QVERIFY(store.compact(history));
+
+    loaded = reload(path);
+    QCOMPARE(loaded.records, history.size());
+    QCOMPARE(texts(loaded.history), texts(history));
+
+    // Closed stores are not reopened
+    store.beginCompaction(history);
+    store.close();
+    QVERIFY(!store.finishCompaction(true));
+    QVERIFY(!store.isOpen());
+}
+
+void ClipboardTests::store_legacy_migration()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto legacy_path = dir.filePath("clipboard_history");
+    const auto path = dir.filePath("log");
+
+    // Missing
+    History history;
+    HistoryStore::loadLegacy(legacy_path, history);
+    QCOMPARE(history.size(), 0);
+
+    // Most recent first, seconds since epoch
+    QFile file(legacy_path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write(R"([{"text":"b","datetime":1700000001},{"text":"a","datetime":1700000000}])");
+    file.close();
+
+    HistoryStore::loadLegacy(legacy_path, history);
+    QCOMPARE(texts(history), QStringList({"b", "a"}));
+
+    vector<QDateTime> datetimes;
+    history.forEach([&](const auto &entry, size_t)
+    { datetimes.emplace_back(entry.datetime); return true; });
+    QCOMPARE(datetimes, vector<QDateTime>({QDateTime::fromSecsSinceEpoch(1700000001),
+                                           QDateTime::fromSecsSinceEpoch(1700000000)}));
+
+    // Migrated by compaction into the empty log
+    HistoryStore store(path);
+    QVERIFY(store.open());
+    const bool abort = false;
+    QCOMPARE(store.load(abort).history.size(), 0);
+    QVERIFY(store.compact(history));
+
+    const auto loaded = reload(path);
+    QVERIFY(!loaded.compact);
+    QCOMPARE(texts(loaded.history), QStringList({"b", "a"}));
+}
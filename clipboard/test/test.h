@@ -0,0 +1,21 @@
+// Copyright (c) 2026 Manuel Schneider
+#include <QCoreApplication>
+#include <QtTest/QtTest>
+
+class ClipboardTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void history_add_remove();
+    void history_truncate();
+    void history_rank();
+    void history_candidates();
+    void store_replay();
+    void store_torn_tail();
+    void store_checksum_mismatch();
+    void store_compaction();
+    void store_legacy_migration();
+
+};
@@ -97,6 +97,11 @@ ConfigWidget::ConfigWidget(Plugin *plu, QWidget *par) : QWidget(par), plugin(plu
                     ui.checkBox_followSymlinks->setChecked(fsp->followSymlinks());
                     ui.spinBox_depth->setValue(static_cast<int>(fsp->maxDepth()));
                     ui.spinBox_interval->setValue(static_cast<int>(fsp->scanInterval()));
+                    ui.spinBox_threads->setValue(static_cast<int>(fsp->scanThreads()));
+                    ui.comboBox_mime->setCurrentIndex(static_cast<int>(fsp->mimeResolution()));
+                    ui.spinBox_priority->setValue(fsp->priority());
+                    ui.spinBox_rate->setValue(static_cast<int>(fsp->maxScanRate()));
+                    ui.checkBox_content->setChecked(fsp->contentIndexing());
                     ui.checkBox_fswatch->setChecked(fsp->watchFileSystem());
                     adjustMimeCheckboxes();
                 }
@@ -135,6 +140,21 @@ ConfigWidget::ConfigWidget(Plugin *plu, QWidget *par) : QWidget(par), plugin(plu
     connect(ui.spinBox_interval, &QSpinBox::editingFinished, this,
             [this](){ plugin->fsIndex().indexPaths().at(current_path)->setScanInterval(ui.spinBox_interval->value()); });
 
+    connect(ui.spinBox_threads, &QSpinBox::editingFinished, this,
+            [this](){ plugin->fsIndex().indexPaths().at(current_path)->setScanThreads(ui.spinBox_threads->value()); });
+
+    connect(ui.comboBox_mime, &QComboBox::activated, this,
+            [this](int index){ plugin->fsIndex().indexPaths().at(current_path)->setMimeResolution(static_cast<MimeResolution>(index)); });
+
+    connect(ui.spinBox_priority, &QSpinBox::editingFinished, this,
+            [this](){ plugin->fsIndex().indexPaths().at(current_path)->setPriority(ui.spinBox_priority->value()); });
+
+    connect(ui.spinBox_rate, &QSpinBox::editingFinished, this,
+            [this](){ plugin->fsIndex().indexPaths().at(current_path)->setMaxScanRate(ui.spinBox_rate->value()); });
+
+    connect(ui.checkBox_content, &QCheckBox::clicked, this,
+            [this](bool value){ plugin->fsIndex().indexPaths().at(current_path)->setContentIndexing(value); });
+
     connect(ui.spinBox_depth, &QSpinBox::editingFinished, this,
             [this](){ plugin->fsIndex().indexPaths().at(current_path)->setMaxDepth(ui.spinBox_depth->value()); });
 
@@ -0,0 +1,417 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "contentindex.h"
+#include "dirlisting.h"
+#include <QDataStream>
+#include <QFile>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+using namespace std;
+
+const qint64 ContentIndex::MAX_FILE_SIZE = 1 << 20;
+static const quint32 SERIALIZATION_MAGIC = 0x54524947;  // TRIG
+static const quint32 SERIALIZATION_VERSION = 2;  // 1 lacks nanoseconds of mtimes
+static const size_t MIN_COMPACTION_SIZE = 1024;  // removed documents
+
+static inline uchar fold(char c) { return (uchar)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c); }
+
+static void fold(QByteArray &data)
+{
+    for (auto &c : data)
+        c = (char)fold(c);
+}
+
+// Sorted, unique
+static vector<uint32_t> trigrams(const QByteArray &data)
+{
+    vector<uint32_t> result;
+    if (data.size() < 3)
+        return result;
+    result.reserve(data.size() - 2);
+    uint32_t trigram = (uint32_t)fold(data[0]) << 8 | fold(data[1]);
+    for (qsizetype i = 2; i < data.size(); ++i)
+    {
+        trigram = (trigram << 8 | fold(data[i])) & 0xFFFFFF;
+        result.push_back(trigram);
+    }
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+static QByteArray readFile(const QString &file_path)
+{
+    QFile file(file_path);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+    return file.read(ContentIndex::MAX_FILE_SIZE);
+}
+
+template<class F>
+static void forEachId(const QByteArray &data, F f)
+{
+    const auto *p = reinterpret_cast<const uchar*>(data.constData());
+    const auto *end = p + data.size();
+    uint32_t id = 0;
+    while (p < end)
+    {
+        uint32_t delta = 0;
+        for (int shift = 0; p < end; shift += 7)
+        {
+            const auto byte = *p++;
+            if (shift < 32)  // else corrupt, rejected by deserialize
+                delta |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        f(id += delta);
+    }
+}
+
+void ContentIndex::PostingList::append(uint32_t id)
+{
+    auto delta = count ? id - last : id;
+    for (; delta >= 0x80; delta >>= 7)
+        data.append((char)(delta | 0x80));
+    data.append((char)delta);
+    last = id;
+    ++count;
+}
+
+void ContentIndex::beginScan()
+{
+    unique_lock lock(mutex_);
+    ++epoch_;
+}
+
+void ContentIndex::finishScan(bool sweep)
+{
+    unique_lock lock(mutex_);
+
+    if (sweep)
+        for (uint32_t id = 0; id < documents_.size(); ++id)
+            if (!documents_[id].name.isNull() && documents_[id].epoch != epoch_)
+            {
+                remove(id);
+                ++revision_;
+            }
+
+    // Here only, since directory updates hold ids across locks
+    if (removed_ > MIN_COMPACTION_SIZE && removed_ > documents_.size() / 2)
+        compact();
+}
+
+void ContentIndex::updateDirectory(const QString &dir_path, const QString &relative_dir_path,
+                                   const vector<QString> &file_names)
+{ update(dir_path, relative_dir_path, &file_names); }
+
+void ContentIndex::refreshDirectory(const QString &dir_path, const QString &relative_dir_path)
+{ update(dir_path, relative_dir_path, nullptr); }
+
+void ContentIndex::update(const QString &dir_path, const QString &relative_dir_path,
+                          const vector<QString> *file_names)
+{
+    // Known documents of the directory
+    map<QString, uint32_t> known_ids;
+    {
+        shared_lock lock(mutex_);
+        if (auto it = directories_.find(relative_dir_path); it != directories_.end())
+            for (auto id : it->second)
+                known_ids.emplace(documents_[id].name, id);
+    }
+    if (!file_names && known_ids.empty())
+        return;
+
+    vector<QString> names;
+    if (!file_names)
+        for (const auto &[name, id] : known_ids)
+            names.emplace_back(name);
+
+    struct Added
+    {
+        QString name;
+        FileStat stat;
+        vector<uint32_t> trigrams;
+    };
+    vector<Added> added;
+    vector<uint32_t> unchanged;
+    vector<uint32_t> removed;
+
+    // Read modified and new files without holding the lock. Mtimes and sizes are read under
+    // the shared lock, documents of this directory are modified by this thread only.
+    for (const auto &name : file_names ? *file_names : names)
+    {
+        const auto file_path = QString("%1/%2").arg(dir_path, name);
+        FileStat stat;
+        const bool indexable = statFile(file_path, stat) && (qint64)stat.size <= MAX_FILE_SIZE;
+
+        if (auto it = known_ids.find(name); it != known_ids.end())
+        {
+            bool modified;
+            {
+                shared_lock lock(mutex_);
+                const auto &doc = documents_[it->second];
+                modified = !indexable || doc.mtime != stat.mtime
+                           || doc.mtime_nsec != stat.mtime_nsec || doc.size != stat.size;
+            }
+            (modified ? removed : unchanged).emplace_back(it->second);
+            known_ids.erase(it);
+            if (!modified)
+                continue;
+        }
+
+        if (indexable)
+        {
+            auto data = readFile(file_path);
+            added.push_back({name, stat, data.contains('\0') ? vector<uint32_t>{} : trigrams(data)});
+        }
+    }
+
+    // Remaining known documents do not exist anymore
+    for (const auto &[name, id] : known_ids)
+        removed.emplace_back(id);
+
+    unique_lock lock(mutex_);
+
+    for (auto id : unchanged)
+        documents_[id].epoch = epoch_;
+
+    for (auto id : removed)
+        remove(id);
+
+    if (!added.empty())
+    {
+        auto &ids = directories_[relative_dir_path];
+        for (auto &a : added)
+        {
+            const auto id = (uint32_t)documents_.size();
+            documents_.push_back({relative_dir_path, ::move(a.name), a.stat.mtime,
+                                  a.stat.mtime_nsec, a.stat.size, epoch_});
+            ids.emplace_back(id);
+            for (auto trigram : a.trigrams)
+                postings_[trigram].append(id);
+        }
+    }
+
+    if (!added.empty() || !removed.empty())
+        ++revision_;
+}
+
+void ContentIndex::remove(uint32_t id)
+{
+    auto &doc = documents_[id];
+    if (auto it = directories_.find(doc.dir); it != directories_.end())
+    {
+        auto &ids = it->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        if (ids.empty())
+            directories_.erase(it);
+    }
+    doc.name = QString();
+    ++removed_;
+}
+
+void ContentIndex::compact()
+{
+    // Renumber the live documents, the order and hence sorted posting lists are kept
+    const auto none = numeric_limits<uint32_t>::max();
+    vector<uint32_t> ids(documents_.size(), none);
+    vector<Document> documents;
+    documents.reserve(documents_.size() - removed_);
+    for (uint32_t id = 0; id < documents_.size(); ++id)
+        if (!documents_[id].name.isNull())
+        {
+            ids[id] = (uint32_t)documents.size();
+            documents.emplace_back(::move(documents_[id]));
+        }
+
+    for (auto it = postings_.begin(); it != postings_.end();)
+    {
+        PostingList compacted;
+        forEachId(it->second.data, [&](uint32_t id){
+            if (id < ids.size() && ids[id] != none)
+                compacted.append(ids[id]);
+        });
+        if (compacted.count)
+        {
+            compacted.data.squeeze();
+            it->second = ::move(compacted);
+            ++it;
+        }
+        else
+            it = postings_.erase(it);
+    }
+
+    for (auto &[dir, dir_ids] : directories_)
+        for (auto &id : dir_ids)
+            id = ids[id];
+
+    documents_ = ::move(documents);
+    removed_ = 0;
+}
+
+vector<QString> ContentIndex::find(const QString &root_path, const QString &text,
+                                   size_t max_results, const function<bool()> &cancelled) const
+{ return verify(candidates(root_path, text), text, max_results, cancelled); }
+
+vector<QString> ContentIndex::candidates(const QString &root_path, const QString &text) const
+{
+    auto needle = text.toUtf8();
+    fold(needle);
+    const auto keys = trigrams(needle);
+    if (keys.empty())
+        return {};
+
+    vector<QString> candidates;
+    {
+        shared_lock lock(mutex_);
+
+        vector<const PostingList*> lists;
+        for (auto key : keys)
+            if (auto it = postings_.find(key); it == postings_.end())
+                return {};
+            else
+                lists.emplace_back(&it->second);
+
+        // Intersect, shortest lists first
+        sort(lists.begin(), lists.end(), [](auto *l, auto *r){ return l->count < r->count; });
+        vector<uint32_t> ids;
+        ids.reserve(lists.front()->count);
+        forEachId(lists.front()->data, [&](uint32_t id){ ids.emplace_back(id); });
+        for (size_t i = 1; i < lists.size() && !ids.empty(); ++i)
+        {
+            vector<uint32_t> intersection;
+            auto it = ids.begin();
+            forEachId(lists[i]->data, [&](uint32_t id){
+                while (it != ids.end() && *it < id)
+                    ++it;
+                if (it != ids.end() && *it == id)
+                    intersection.emplace_back(id);
+            });
+            ids.swap(intersection);
+        }
+
+        for (auto id : ids)
+            if (const auto &doc = documents_[id]; !doc.name.isNull())
+                candidates.emplace_back(QString("%1%2/%3").arg(root_path, doc.dir, doc.name));
+    }
+    return candidates;
+}
+
+vector<QString> ContentIndex::verify(const vector<QString> &file_paths, const QString &text,
+                                     size_t max_results, const function<bool()> &cancelled)
+{
+    auto needle = text.toUtf8();
+    fold(needle);
+
+    // Trigrams match, verify the sequence
+    vector<QString> results;
+    for (const auto &file_path : file_paths)
+    {
+        if (results.size() >= max_results || (cancelled && cancelled()))
+            break;
+        auto data = readFile(file_path);
+        fold(data);
+        if (data.contains(needle))
+            results.emplace_back(file_path);
+    }
+    return results;
+}
+
+uint64_t ContentIndex::revision() const { return revision_; }
+
+size_t ContentIndex::documentCount() const
+{
+    shared_lock lock(mutex_);
+    return documents_.size() - removed_;
+}
+
+void ContentIndex::clear()
+{
+    unique_lock lock(mutex_);
+    documents_.clear();
+    directories_.clear();
+    postings_.clear();
+    removed_ = 0;
+    ++revision_;
+}
+
+void ContentIndex::serialize(QDataStream &stream) const
+{
+    shared_lock lock(mutex_);
+
+    stream << SERIALIZATION_MAGIC << SERIALIZATION_VERSION << epoch_ << (quint32)documents_.size();
+    for (const auto &doc : documents_)
+        stream << doc.dir << doc.name << (quint64)doc.mtime << doc.mtime_nsec
+               << (quint64)doc.size << doc.epoch;
+
+    stream << (quint32)postings_.size();
+    for (const auto &[trigram, list] : postings_)
+        stream << trigram << list.last << list.count << list.data;
+}
+
+void ContentIndex::deserialize(QDataStream &stream)
+{
+    quint32 magic, version, epoch, document_count, posting_count;
+    stream >> magic >> version >> epoch >> document_count;
+    if (stream.status() != QDataStream::Ok || magic != SERIALIZATION_MAGIC)
+        throw runtime_error("Content index data has no valid magic number.");
+    if (version < 1 || version > SERIALIZATION_VERSION)
+        throw runtime_error(QString("Unsupported content index version: %1.").arg(version).toStdString());
+
+    vector<Document> documents;
+    unordered_map<QString, vector<uint32_t>> directories;
+    size_t removed = 0;
+    for (quint32 id = 0; id < document_count && stream.status() == QDataStream::Ok; ++id)
+    {
+        Document doc;
+        quint64 mtime, size;
+        quint32 mtime_nsec = 0;  // version 1 documents are reread once
+        stream >> doc.dir >> doc.name >> mtime;
+        if (version >= 2)
+            stream >> mtime_nsec;
+        stream >> size >> doc.epoch;
+        doc.mtime = mtime;
+        doc.mtime_nsec = mtime_nsec;
+        doc.size = size;
+        if (doc.name.isNull())
+            ++removed;
+        else
+            directories[doc.dir].emplace_back(id);
+        documents.emplace_back(::move(doc));
+    }
+
+    unordered_map<uint32_t, PostingList> postings;
+    stream >> posting_count;
+    for (quint32 i = 0; i < posting_count && stream.status() == QDataStream::Ok; ++i)
+    {
+        quint32 trigram;
+        PostingList list;
+        stream >> trigram >> list.last >> list.count >> list.data;
+
+        // find indexes documents by the decoded ids
+        uint32_t count = 0, last = 0;
+        bool valid = true;
+        forEachId(list.data, [&](uint32_t id){
+            valid = valid && id < documents.size() && (count == 0 || id > last);
+            last = id;
+            ++count;
+        });
+        if (!valid || count != list.count || (count && last != list.last))
+            throw runtime_error("Document reference out of bounds.");
+        postings.emplace(trigram, ::move(list));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        throw runtime_error("Content index data truncated.");
+
+    unique_lock lock(mutex_);
+    documents_ = ::move(documents);
+    directories_ = ::move(directories);
+    postings_ = ::move(postings);
+    removed_ = removed;
+    epoch_ = epoch;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+class QDataStream;
+
+///
+/// Trigram index of the contents of text files
+///
+/// Maps the trigrams of the file contents to posting lists of document ids.
+/// Trigrams are taken from the bytes of the files, ASCII letters case folded.
+/// Posting lists are sorted and delta plus varint encoded. Modified files get
+/// new document ids, ids of removed documents are dropped on compaction.
+///
+/// Lookups intersect the posting lists of the trigrams of the searched text,
+/// starting with the shortest, and verify the candidates by reading them.
+///
+/// Documents are keyed by their directory path relative to the index root and
+/// their name. All functions are thread-safe.
+///
+class ContentIndex
+{
+public:
+    static const qint64 MAX_FILE_SIZE;  // larger files are not indexed
+
+    /// Starts a scan. Directories are updated in between only.
+    void beginScan();
+
+    /// Finishes a scan. If sweep is set, documents in directories not visited
+    /// since beginScan are removed, i.e. a full scan must have visited all.
+    void finishScan(bool sweep);
+
+    /// Updates the documents of a directory to the given text files
+    void updateDirectory(const QString &dir_path, const QString &relative_dir_path,
+                         const std::vector<QString> &file_names);
+
+    /// Checks the known documents of an otherwise unchanged directory for modifications
+    void refreshDirectory(const QString &dir_path, const QString &relative_dir_path);
+
+    /// Finds files containing text, ASCII case insensitive. Needs at least three bytes.
+    /// @returns file paths, root_path prepended to the relative paths
+    std::vector<QString> find(const QString &root_path, const QString &text,
+                              size_t max_results, const std::function<bool()> &cancelled) const;
+
+    /// The files containing the trigrams of text, the unverified results of find
+    std::vector<QString> candidates(const QString &root_path, const QString &text) const;
+
+    /// Reads the files to check whether they contain text. Does not access any index.
+    static std::vector<QString> verify(const std::vector<QString> &file_paths, const QString &text,
+                                       size_t max_results, const std::function<bool()> &cancelled);
+
+    uint64_t revision() const;  // changes with every modification
+    size_t documentCount() const;
+
+    void clear();
+    void serialize(QDataStream &) const;
+    void deserialize(QDataStream &);  // throws runtime_error
+
+private:
+
+    struct Document
+    {
+        QString dir;  // relative path
+        QString name;  // null if removed
+        uint64_t mtime;
+        uint32_t mtime_nsec;
+        uint64_t size;
+        uint32_t epoch;  // of the last scan visiting the document
+    };
+
+    struct PostingList
+    {
+        QByteArray data;  // delta encoded varints
+        uint32_t last = 0;  // last document id
+        uint32_t count = 0;
+        void append(uint32_t id);
+    };
+
+    void update(const QString &dir_path, const QString &relative_dir_path,
+                const std::vector<QString> *file_names);
+    void remove(uint32_t id);  // expects the unique lock
+    void compact();  // expects the unique lock
+
+    mutable std::shared_mutex mutex_;
+    std::vector<Document> documents_;  // by id
+    std::unordered_map<QString, std::vector<uint32_t>> directories_;  // live ids by directory
+    std::unordered_map<uint32_t, PostingList> postings_;  // by trigram
+    size_t removed_ = 0;
+    uint32_t epoch_ = 0;
+    std::atomic<uint64_t> revision_ = 0;
+};
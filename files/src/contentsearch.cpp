@@ -0,0 +1,43 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "contentsearch.h"
+#include "fileitems.h"
+#include "fsindex.h"
+#include "scanthrottle.h"
+#include <QMimeDatabase>
+using namespace albert;
+using namespace std;
+
+static const size_t MAX_RESULTS = 50;
+
+ContentSearchHandler::ContentSearchHandler(const FsIndex &fsIndex) : fs_index_(fsIndex) {}
+
+QString ContentSearchHandler::id() const { return QStringLiteral("grep"); }
+
+QString ContentSearchHandler::name() const { return tr("Content search"); }
+
+QString ContentSearchHandler::description() const
+{ return tr("Search the contents of indexed text files"); }
+
+QString ContentSearchHandler::defaultTrigger() const { return QStringLiteral("grep "); }
+
+QString ContentSearchHandler::synopsis(const QString &) const { return tr("<text>"); }
+
+void ContentSearchHandler::handleTriggerQuery(Query &query)
+{
+    ScanThrottle::notifyQuery();
+
+    const auto text = query.string();
+    if (text.toUtf8().size() < 3)  // trigrams
+        return;
+
+    QMimeDatabase mdb;
+    vector<shared_ptr<Item>> items;
+    for (const auto &file_path : fs_index_.findContent(text, MAX_RESULTS,
+                                                       [&query]{ return !query.isValid(); }))
+        items.emplace_back(make_shared<StandardFile>(
+            file_path, mdb.mimeTypeForFile(file_path, QMimeDatabase::MatchExtension)));
+
+    if (query.isValid())
+        query.add(::move(items));
+}
@@ -0,0 +1,22 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QCoreApplication>
+#include <albert/triggerqueryhandler.h>
+class FsIndex;
+
+// Searches the content indices of the index paths
+class ContentSearchHandler : public albert::TriggerQueryHandler
+{
+    Q_DECLARE_TR_FUNCTIONS(ContentSearchHandler)
+public:
+    ContentSearchHandler(const FsIndex &fsIndex);
+    QString id() const override;
+    QString name() const override;
+    QString description() const override;
+    QString defaultTrigger() const override;
+    QString synopsis(const QString &) const override;
+    void handleTriggerQuery(albert::Query &) override;
+private:
+    const FsIndex &fs_index_;
+};
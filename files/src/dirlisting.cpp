@@ -0,0 +1,176 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "dirlisting.h"
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#if defined(Q_OS_UNIX)
+#include <sys/stat.h>
+#endif
+#if defined(Q_OS_LINUX)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+struct linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Type of the file at name relative to dirfd (S_IFMT bits), 0 on error
+mode_t fileType(int dirfd, const char *name, int flags)
+{
+    struct statx stx;
+    if (statx(dirfd, name, flags | AT_STATX_DONT_SYNC, STATX_TYPE, &stx) == 0
+        && stx.stx_mask & STATX_TYPE)
+        return stx.stx_mode & S_IFMT;
+    return 0;
+}
+
+}
+
+vector<DirEntry> listDirectory(const QString &path, bool include_hidden,
+                               const function<bool()> &cancelled)
+{
+    vector<DirEntry> entries;
+
+    const int fd = open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return entries;
+
+    alignas(linux_dirent64) char buffer[32 * 1024];
+    for (long size; (size = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0;)
+    {
+        if (cancelled && cancelled())
+        {
+            entries.clear();
+            break;
+        }
+
+        for (long offset = 0; offset < size;)
+        {
+            const auto *dirent = reinterpret_cast<const linux_dirent64 *>(buffer + offset);
+            offset += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.')
+            {
+                if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))
+                    continue;  // . and ..
+                if (!include_hidden)
+                    continue;
+            }
+
+            unsigned char type = dirent->d_type;
+            if (type == DT_UNKNOWN)  // Not all file systems provide types
+                type = IFTODT(fileType(fd, name, AT_SYMLINK_NOFOLLOW));
+
+            const bool is_symlink = type == DT_LNK;
+            if (is_symlink)  // Type of the target, DT_UNKNOWN if dangling
+                type = IFTODT(fileType(fd, name, 0));
+
+            if (type == DT_DIR || type == DT_REG)
+                entries.push_back({QFile::decodeName(name), type == DT_DIR, is_symlink});
+        }
+    }
+
+    close(fd);
+
+    // Same order as QDir::Name
+    sort(entries.begin(), entries.end(),
+         [](const DirEntry &l, const DirEntry &r){ return l.name < r.name; });
+
+    return entries;
+}
+
+bool statFile(const QString &path, FileStat &stat)
+{
+    struct statx stx;
+    if (statx(AT_FDCWD, QFile::encodeName(path).constData(), AT_STATX_DONT_SYNC,
+              STATX_INO | STATX_MTIME | STATX_SIZE, &stx) != 0
+        || (stx.stx_mask & (STATX_INO | STATX_MTIME)) != (STATX_INO | STATX_MTIME))
+        return false;
+
+    stat.id.device = ((uint64_t)stx.stx_dev_major << 32) | stx.stx_dev_minor;
+    stat.id.inode = stx.stx_ino;
+    stat.mtime = (uint64_t)stx.stx_mtime.tv_sec;
+    stat.mtime_nsec = stx.stx_mtime.tv_nsec;
+    stat.size = (stx.stx_mask & STATX_SIZE) ? stx.stx_size : 0;
+    return true;
+}
+
+#else
+
+vector<DirEntry> listDirectory(const QString &path, bool include_hidden,
+                               const function<bool()> &cancelled)
+{ return listDirectoryPortable(path, include_hidden, cancelled); }
+
+bool statFile(const QString &path, FileStat &stat)
+{
+#if defined(Q_OS_UNIX)
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+    stat.id.device = (uint64_t)st.st_dev;
+    stat.id.inode = (uint64_t)st.st_ino;
+    stat.mtime = (uint64_t)st.st_mtime;
+#if defined(Q_OS_MACOS)
+    stat.mtime_nsec = (uint32_t)st.st_mtimespec.tv_nsec;
+#else
+    stat.mtime_nsec = (uint32_t)st.st_mtim.tv_nsec;
+#endif
+    stat.size = (uint64_t)st.st_size;
+#else
+    // No inodes, identify directories by their canonical path
+    const QFileInfo fi(path);
+    if (!fi.exists())
+        return false;
+    stat.id.device = 0;
+    stat.id.inode = qHash(fi.canonicalFilePath());
+    const auto msecs = fi.lastModified().toMSecsSinceEpoch();
+    stat.mtime = (uint64_t)(msecs / 1000);
+    stat.mtime_nsec = (uint32_t)(msecs % 1000) * 1000000;
+    stat.size = (uint64_t)fi.size();
+#endif
+    return true;
+}
+
+#endif
+
+vector<DirEntry> listDirectoryPortable(const QString &path, bool include_hidden,
+                                       const function<bool()> &cancelled)
+{
+    auto filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
+    if (include_hidden)
+        filters |= QDir::Hidden;
+
+    vector<DirEntry> entries;
+    for (QDirIterator it(path, filters); it.hasNext();)
+    {
+        if (cancelled && cancelled())
+            return {};
+        it.next();
+        const auto fi = it.fileInfo();
+        entries.push_back({fi.fileName(), fi.isDir(), fi.isSymLink()});
+    }
+
+    // Same order as QDir::Name
+    sort(entries.begin(), entries.end(),
+         [](const DirEntry &l, const DirEntry &r){ return l.name < r.name; });
+
+    return entries;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct DirEntry
+{
+    QString name;
+    bool is_dir;  // of the link target for symlinks
+    bool is_symlink;
+};
+
+///
+/// Lists the entries of the directory at path, sorted by name
+///
+/// Skips '.' and '..', dangling links and everything but regular files and
+/// directories, like QDir::Files | QDir::Dirs would. Hidden entries are
+/// listed if include_hidden is set. On Linux the entry types are read from
+/// the directory stream (getdents64). Only links and entries of file
+/// systems not providing types are stat'ed.
+///
+/// If cancelled is set and returns true, listing stops and the result is empty.
+///
+std::vector<DirEntry> listDirectory(const QString &path, bool include_hidden,
+                                    const std::function<bool()> &cancelled = {});
+
+/// QDir based listDirectory. The fallback on other platforms.
+std::vector<DirEntry> listDirectoryPortable(const QString &path, bool include_hidden,
+                                            const std::function<bool()> &cancelled = {});
+
+// Identifies a file independent of the path it is reached by
+struct FileId
+{
+    uint64_t device;
+    uint64_t inode;
+    bool operator==(const FileId &other) const
+    { return device == other.device && inode == other.inode; }
+};
+
+struct FileIdHash
+{
+    size_t operator()(const FileId &id) const noexcept
+    { return std::hash<uint64_t>()(id.inode ^ (id.device * 0x9e3779b97f4a7c15ull)); }
+};
+
+struct FileStat
+{
+    FileId id;
+    uint64_t mtime;  // seconds since epoch
+    uint32_t mtime_nsec;  // nanoseconds of mtime, precision depends on the file system
+    uint64_t size;  // bytes
+};
+
+/// Stats the file at path, following links. A single statx on Linux.
+/// @returns false on error
+bool statFile(const QString &path, FileStat &stat);
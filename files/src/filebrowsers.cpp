@@ -2,18 +2,45 @@
 
 #include "filebrowsers.h"
 #include "fileitems.h"
+#include "fsindex.h"
+#include "scanthrottle.h"
 #include <albert/logging.h>
 #include <QCoreApplication>
 #include <QDir>
-#include <QDirIterator>
-#include <QFileInfo>
-#include <QMimeDatabase>
 #include <QFileInfo>
+#include <QRegularExpression>
+#include <algorithm>
+#include <functional>
 using namespace albert;
 using namespace std;
 
-FilePathBrowser::FilePathBrowser(bool &matchCaseSensitive, bool &showHidden,
+static const size_t MAX_CANDIDATES = 32;  // per segment of abbreviated paths
+static const size_t MAX_RESULTS = 100;
+
+static QString joinPath(const QString &dir_path, const QString &name)
+{ return dir_path.endsWith(u'/') ? dir_path + name : QString("%1/%2").arg(dir_path, name); }
+
+// Quality of a path segment match in (0, 1], 0 if the segment does not match
+static double segmentScore(QStringView name, QStringView segment, Qt::CaseSensitivity cs)
+{
+    if (segment.isEmpty())
+        return 1.;
+
+    const auto coverage = (double)segment.size() / name.size();
+    if (name.startsWith(segment, cs))
+        return .5 + .5 * coverage;
+
+    // Abbreviation, the characters of the segment in order
+    qsizetype pos = 0;
+    for (const auto c : segment)
+        if (pos = name.indexOf(c, pos, cs); pos++ < 0)
+            return 0.;
+    return (name.first(1).compare(segment.first(1), cs) == 0 ? .25 : .1) + .25 * coverage;
+}
+
+FilePathBrowser::FilePathBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                                  bool &sortCaseSensitive, bool &showDirsFirst):
+    fs_index_(fsIndex),
     match_case_sensitive_(matchCaseSensitive),
     show_hidden_(showHidden),
     sort_case_insensitive_(sortCaseSensitive),
@@ -22,40 +49,173 @@ FilePathBrowser::FilePathBrowser(bool &matchCaseSensitive, bool &showHidden,
 
 bool FilePathBrowser::allowTriggerRemap() const { return false; }
 
-QFileInfoList FilePathBrowser::listFiles(const QString &filter_path) const
+shared_ptr<const FilePathBrowser::Listing>
+FilePathBrowser::listing(const Query &query, const QString &path) const
+{
+    FileStat stat;
+    if (!statFile(path, stat))
+        return {};
+
+    const bool sort_case_insensitive = sort_case_insensitive_;
+    const bool show_dirs_first = show_dirs_first_;
+
+    {
+        lock_guard lock(listing_mutex_);
+        if (listing_ && listing_->path == path && listing_->mtime == stat.mtime
+            && listing_->mtime_nsec == stat.mtime_nsec
+            && listing_->sort_case_insensitive == sort_case_insensitive
+            && listing_->show_dirs_first == show_dirs_first)
+            return listing_;
+    }
+
+    auto entries = listDirectory(path, true, [&query]{ return !query.isValid(); });
+    if (!query.isValid())
+        return {};
+
+    const auto cs = sort_case_insensitive ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    stable_sort(entries.begin(), entries.end(), [&](const DirEntry &l, const DirEntry &r){
+        if (show_dirs_first && l.is_dir != r.is_dir)
+            return l.is_dir;
+        return l.name.compare(r.name, cs) < 0;
+    });
+
+    auto l = make_shared<const Listing>(Listing{path, stat.mtime, stat.mtime_nsec,
+                                                sort_case_insensitive,
+                                                show_dirs_first, ::move(entries)});
+    lock_guard lock(listing_mutex_);
+    return listing_ = ::move(l);
+}
+
+vector<shared_ptr<Item>> FilePathBrowser::listFiles(const Query &query,
+                                                    const QString &filter_path,
+                                                    qsizetype completion_offset) const
 {
+    vector<shared_ptr<Item>> results;
+
     QFileInfo query_file_info(filter_path);
-    QDir dir(query_file_info.path());
+    const auto dir_path = query_file_info.path();
+    const auto prefix = query_file_info.fileName();
+
+    const auto l = listing(query, dir_path);
+    if (!l)
+        return results;
+
+    const auto cs = match_case_sensitive_ ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    const bool show_hidden = show_hidden_ || prefix.startsWith(u'.');
+    const auto completion_path = QString(dir_path).append(dir_path.endsWith(u'/') ? "" : "/")
+                                     .mid(completion_offset);
+
+    // Plain prefixes are the common case, wildcards as supported by QDir name filters
+    function<bool(const QString&)> matches = [&](const QString &name){ return name.startsWith(prefix, cs); };
+    QRegularExpression glob;
+    if (prefix.contains(QRegularExpression(R"([*?\[])")))
+    {
+        glob = QRegularExpression::fromWildcard(prefix + u'*', cs);
+        matches = [&](const QString &name){ return glob.match(name).hasMatch(); };
+    }
+
+    for (const auto &entry : l->entries)
+        if ((show_hidden || !entry.name.startsWith(u'.')) && matches(entry.name))
+        {
+            auto completion = completion_path + entry.name;
+            if (entry.is_dir)
+                completion.append(QDir::separator());
+            results.emplace_back(make_shared<BrowsedFile>(dir_path, entry.name, entry.is_dir,
+                                                          ::move(completion)));
+        }
+
+    return results;
+}
 
-    if (dir.exists())
+vector<shared_ptr<Item>> FilePathBrowser::completeAbbreviated(const Query &query,
+                                                              const QString &base_path,
+                                                              const QString &relative_path,
+                                                              qsizetype completion_offset) const
+{
+    auto segments = QStringView(relative_path).split(u'/', Qt::SkipEmptyParts);
+    if (relative_path.endsWith(u'/'))
+        segments.emplace_back();  // list the matching directories
+
+    struct Candidate
+    {
+        QString dir_path;
+        QString name;
+        bool is_dir;
+        double score;
+    };
+    vector<Candidate> candidates{{{}, base_path, true, 0.}};
+    const auto cs = match_case_sensitive_ ? Qt::CaseSensitive : Qt::CaseInsensitive;
+
+    for (qsizetype i = 0; i < segments.size() && !candidates.empty(); ++i)
+    {
+        const auto &segment = segments[i];
+        const bool last = i + 1 == segments.size();
+        const bool show_hidden = show_hidden_ || segment.startsWith(u'.');
+
+        vector<Candidate> matches;
+        for (const auto &candidate : candidates)
+        {
+            if (!query.isValid())
+                return {};
+
+            const auto dir_path = candidate.dir_path.isNull()
+                                      ? candidate.name : joinPath(candidate.dir_path, candidate.name);
+            // The index lacks files excluded by mime filters, hence list the last segment
+            vector<DirEntry> entries;
+            if (vector<QString> names;
+                !last && fs_index_.listDirectories(dir_path, show_hidden, names))
+                for (auto &name : names)
+                    entries.push_back({::move(name), true, false});
+            else
+                entries = listDirectory(dir_path, true, [&query]{ return !query.isValid(); });
+
+            for (auto &entry : entries)
+                if ((last || entry.is_dir) && (show_hidden || !entry.name.startsWith(u'.')))
+                    if (const auto score = segmentScore(entry.name, segment, cs); score > 0.)
+                        matches.push_back({dir_path, ::move(entry.name), entry.is_dir,
+                                           candidate.score + score});
+        }
+
+        // Keep the best matches only
+        const auto by_score = [](const Candidate &l, const Candidate &r){ return l.score > r.score; };
+        if (const auto limit = last ? MAX_RESULTS : MAX_CANDIDATES; matches.size() > limit)
+        {
+            nth_element(matches.begin(), matches.begin() + limit, matches.end(), by_score);
+            matches.resize(limit);
+        }
+        stable_sort(matches.begin(), matches.end(), by_score);
+        candidates = ::move(matches);
+    }
+
+    vector<shared_ptr<Item>> results;
+    for (auto &candidate : candidates)
     {
-        auto pattern = query_file_info.fileName() + "*";
-
-        auto filters = QDir::AllEntries | QDir::NoDotAndDotDot;
-        if (match_case_sensitive_)
-            filters |= QDir::CaseSensitive;
-        if (show_hidden_ || query_file_info.fileName().startsWith(QStringLiteral(".")))
-            filters |= QDir::Hidden;
-
-        QDir::SortFlags sort_flags = QDir::Name;
-        if (sort_case_insensitive_)
-            sort_flags |= QDir::IgnoreCase;
-        if (show_dirs_first_)
-            sort_flags |= QDir::DirsFirst;
-
-        if (pattern.isEmpty())
-            return dir.entryInfoList(filters, sort_flags);
-        else
-            return dir.entryInfoList({pattern}, filters, sort_flags);
+        auto completion = joinPath(candidate.dir_path, candidate.name).mid(completion_offset);
+        if (candidate.is_dir)
+            completion.append(QDir::separator());
+        results.emplace_back(make_shared<BrowsedFile>(::move(candidate.dir_path),
+                                                      ::move(candidate.name),
+                                                      candidate.is_dir, ::move(completion)));
     }
-    return {};
+    return results;
+}
+
+vector<shared_ptr<Item>> FilePathBrowser::completePath(const Query &query,
+                                                       const QString &base_path,
+                                                       const QString &relative_path,
+                                                       qsizetype completion_offset) const
+{
+    const auto filter_path = base_path + relative_path;
+    if (QFileInfo(QFileInfo(filter_path).path()).isDir())
+        return listFiles(query, filter_path, completion_offset);
+    return completeAbbreviated(query, base_path, relative_path, completion_offset);
 }
 
 // -------------------------------------------------------------------------------------------------
 
-RootBrowser::RootBrowser(bool &matchCaseSensitive, bool &showHidden,
+RootBrowser::RootBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                          bool &sortCaseSensitive, bool &showDirsFirst):
-    FilePathBrowser(matchCaseSensitive, showHidden, sortCaseSensitive, showDirsFirst)
+    FilePathBrowser(fsIndex, matchCaseSensitive, showHidden, sortCaseSensitive, showDirsFirst)
 {}
 
 QString RootBrowser::id() const { return "rootbrowser"; }
@@ -68,27 +228,16 @@ QString RootBrowser::defaultTrigger() const { return QStringLiteral("/"); }
 
 void RootBrowser::handleTriggerQuery(Query &query)
 {
-    vector<shared_ptr<Item>> results;
-    QMimeDatabase mimeDatabase;
-    for (const auto &fi : listFiles(defaultTrigger() + query.string()))
-    {
-        QMimeType mimetype = mimeDatabase.mimeTypeForFile(fi);
-        QString completion = fi.filePath().mid(1);
-        if (fi.isDir())
-            completion.append(QDir::separator());
-
-        results.emplace_back(make_shared<StandardFile>(fi.filePath(), mimetype, completion));
-    }
-
-    query.add(::move(results));
+    ScanThrottle::notifyQuery();
+    query.add(completePath(query, defaultTrigger(), query.string(), 1));
 }
 
 
 // -------------------------------------------------------------------------------------------------
 
-HomeBrowser::HomeBrowser(bool &matchCaseSensitive, bool &showHidden,
+HomeBrowser::HomeBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                          bool &sortCaseSensitive, bool &showDirsFirst):
-    FilePathBrowser(matchCaseSensitive, showHidden, sortCaseSensitive, showDirsFirst)
+    FilePathBrowser(fsIndex, matchCaseSensitive, showHidden, sortCaseSensitive, showDirsFirst)
 {}
 
 QString HomeBrowser::id() const { return "homebrowser"; }
@@ -101,20 +250,8 @@ QString HomeBrowser::defaultTrigger() const { return QStringLiteral("~"); }
 
 void HomeBrowser::handleTriggerQuery(Query &query)
 {
-    vector<shared_ptr<Item>> results;
-    QMimeDatabase mimeDatabase;
-    auto home_length = QDir::homePath().size();
-    for (const auto &fi : listFiles(QDir::homePath() + query.string()))
-    {
-        QMimeType mimetype = mimeDatabase.mimeTypeForFile(fi);
-        QString completion = fi.filePath().mid(home_length);
-        if (fi.isDir())
-            completion.append(QDir::separator());
-
-        results.emplace_back(make_shared<StandardFile>(fi.filePath(), mimetype, completion));
-    }
-
-    query.add(::move(results));
+    ScanThrottle::notifyQuery();
+    query.add(completePath(query, QDir::homePath(), query.string(), QDir::homePath().size()));
 }
 
 
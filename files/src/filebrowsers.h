@@ -1,24 +1,61 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
 #pragma once
+#include "dirlisting.h"
 #include <QCoreApplication>
-#include <QFileInfoList>
 #include <albert/triggerqueryhandler.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+class FsIndex;
 
 class FilePathBrowser : public albert::TriggerQueryHandler
 {
 public:
 
-    FilePathBrowser(bool &matchCaseSensitive, bool &showHidden,
+    FilePathBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                     bool &sortCaseSensitive, bool &showDirsFirst);
     bool allowTriggerRemap() const override;
 
 protected:
 
-    QFileInfoList listFiles(const QString &filter_path) const;
+    /// Completes base_path + relative_path. If the parent directory does not exist, the
+    /// segments are matched as abbreviations, e.g. ~/d/al/src completes ~/dev/albert/src.
+    std::vector<std::shared_ptr<albert::Item>> completePath(const albert::Query &query,
+                                                            const QString &base_path,
+                                                            const QString &relative_path,
+                                                            qsizetype completion_offset) const;
+
+    /// Items of the entries in the directory of filter_path starting with its file name.
+    /// Completions are the file paths starting at completion_offset.
+    std::vector<std::shared_ptr<albert::Item>> listFiles(const albert::Query &query,
+                                                         const QString &filter_path,
+                                                         qsizetype completion_offset) const;
 
 private:
 
+    // Successive queries usually list the same directory
+    struct Listing
+    {
+        QString path;
+        uint64_t mtime;
+        uint32_t mtime_nsec;  // changes within a second
+        bool sort_case_insensitive;
+        bool show_dirs_first;
+        std::vector<DirEntry> entries;  // sorted, including hidden
+    };
+
+    std::shared_ptr<const Listing> listing(const albert::Query &query, const QString &path) const;
+
+    // Beam search over the indexed trees, listing the file system where not indexed
+    std::vector<std::shared_ptr<albert::Item>> completeAbbreviated(const albert::Query &query,
+                                                                   const QString &base_path,
+                                                                   const QString &relative_path,
+                                                                   qsizetype completion_offset) const;
+
+    mutable std::mutex listing_mutex_;
+    mutable std::shared_ptr<const Listing> listing_;
+    const FsIndex &fs_index_;
     bool &match_case_sensitive_;
     bool &show_hidden_;
     bool &sort_case_insensitive_;
@@ -30,7 +67,7 @@ class RootBrowser : public FilePathBrowser
 {
     Q_DECLARE_TR_FUNCTIONS(RootBrowser)
 public:
-    RootBrowser(bool &matchCaseSensitive, bool &showHidden,
+    RootBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                 bool &sortCaseSensitive, bool &showDirsFirst);
     QString id() const override;
     QString name() const override;
@@ -43,7 +80,7 @@ class HomeBrowser : public FilePathBrowser
 {
     Q_DECLARE_TR_FUNCTIONS(HomeBrowser)
 public:
-    HomeBrowser(bool &matchCaseSensitive, bool &showHidden,
+    HomeBrowser(const FsIndex &fsIndex, bool &matchCaseSensitive, bool &showHidden,
                 bool &sortCaseSensitive, bool &showDirsFirst);
     QString id() const override;
     QString name() const override;
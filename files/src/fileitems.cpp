@@ -135,20 +135,67 @@ vector<Action> FileItem::actions() const
 }
 
 
-IndexFileItem::IndexFileItem(const QString &name, const QMimeType &mime, const std::shared_ptr<DirNode> &parent):
-        name_(name), mimetype_(mime), parent_(parent) {}
+IndexFileItem::IndexFileItem(shared_ptr<const DirNode> parent, QString names,
+                             uint32_t name_offset, uint16_t name_size, uint16_t mime):
+        parent_(::move(parent)), names_(::move(names)),
+        name_offset_(name_offset), name_size_(name_size), mime_(mime), resolved_mime_(mime) {}
 
 QString IndexFileItem::name() const
-{ return name_; }
+{ return names_.mid(name_offset_, name_size_); }
 
 QString IndexFileItem::path() const
 { return parent_->filePath(); }
 
 QString IndexFileItem::filePath() const
-{ return QString("%1/%2").arg(parent_->filePath(), name_); }
+{ return QString("%1/%2").arg(parent_->filePath(), QStringView(names_).mid(name_offset_, name_size_)); }
 
 const QMimeType &IndexFileItem::mimeType() const
-{ return mimetype_; }
+{
+    // Lazily resolved mime types are sniffed once they are actually needed
+    call_once(mime_resolved_, [this]{
+        if (!MimeTypeRegistry::mimeType(mime_).isValid())
+            resolved_mime_ = MimeTypeRegistry::id(QMimeDatabase().mimeTypeForFile(filePath()));
+    });
+    return MimeTypeRegistry::mimeType(resolved_mime_);
+}
+
+QStringList IndexFileItem::iconUrls() const
+{
+    // Icons are requested on the GUI thread, do not sniff there. The file icon provider
+    // determines the type of unresolved files by itself.
+    if (!MimeTypeRegistry::mimeType(mime_).isValid())
+        return {QString("qfip:%1").arg(filePath())};
+    return FileItem::iconUrls();
+}
+
+
+BrowsedFile::BrowsedFile(QString path, QString name, bool is_dir, QString completion):
+        path_(::move(path)), name_(::move(name)), completion_(::move(completion))
+{
+    if (is_dir)
+        mimetype_ = DirNode::dirMimeType();
+}
+
+QString BrowsedFile::name() const
+{ return name_; }
+
+QString BrowsedFile::path() const
+{ return path_; }
+
+QString BrowsedFile::filePath() const
+{ return QDir(path_).filePath(name_); }
+
+const QMimeType &BrowsedFile::mimeType() const
+{
+    call_once(mime_resolved_, [this]{
+        if (!mimetype_.isValid())
+            mimetype_ = QMimeDatabase().mimeTypeForFile(filePath());
+    });
+    return mimetype_;
+}
+
+QString BrowsedFile::inputActionText() const
+{ return completion_; }
 
 
 StandardFile::StandardFile(QString path, QMimeType mimetype, QString completion)
@@ -3,6 +3,7 @@
 #pragma once
 #include <QMimeType>
 #include <albert/item.h>
+#include <mutex>
 class DirNode;
 
 
@@ -22,18 +23,44 @@ public:
 };
 
 
+// Shares the packed name buffer of its directory, see DirNode::items.
 class IndexFileItem : public FileItem
 {
 public:
-    explicit IndexFileItem(const QString &name, const QMimeType &mime, const std::shared_ptr<DirNode> &parent);
+    IndexFileItem(std::shared_ptr<const DirNode> parent, QString names,
+                  uint32_t name_offset, uint16_t name_size, uint16_t mime);
     QString name() const override;
     QString path() const override;
     QString filePath() const override;
     const QMimeType &mimeType() const override;
+    QStringList iconUrls() const override;
+private:
+    const std::shared_ptr<const DirNode> parent_;
+    const QString names_;
+    const uint32_t name_offset_;
+    const uint16_t name_size_;
+    const uint16_t mime_;  // invalid if unresolved
+    mutable uint16_t resolved_mime_;
+    mutable std::once_flag mime_resolved_;
+};
+
+
+// Listed by the file browsers. The mime type is determined on first use.
+class BrowsedFile : public FileItem
+{
+public:
+    BrowsedFile(QString path, QString name, bool is_dir, QString completion);
+    QString name() const override;
+    QString path() const override;
+    QString filePath() const override;
+    const QMimeType &mimeType() const override;
+    QString inputActionText() const override;
 private:
+    const QString path_;
     const QString name_;
-    const QMimeType mimetype_;
-    const std::shared_ptr<DirNode> parent_;
+    const QString completion_;
+    mutable QMimeType mimetype_;
+    mutable std::once_flag mime_resolved_;
 };
 
 
@@ -1,37 +1,79 @@
 // Copyright (c) 2022-2025 Manuel Schneider
 
 #include "fsindex.h"
+#include <QThread>
 #include <QtConcurrentRun>
 #include <albert/logging.h>
 using namespace std;
 
-FsIndex::FsIndex(): abort(false)
+FsIndex::FsIndex():
+    max_concurrent_scans(clamp((uint)QThread::idealThreadCount() / 4, 1u, 4u))
+{}
+
+FsIndex::~FsIndex() { stop(); }
+
+const map<QString,unique_ptr<FsIndexPath>> &FsIndex::indexPaths() const
+{ return index_paths_; }
+
+void FsIndex::forEachPath(const function<void(const FsIndexPath&)> &visit) const
 {
-    QObject::connect(&future_watcher, &QFutureWatcher<void>::finished, this, [this](){
-        updating = nullptr;
-        if (queue.empty())
-            emit updatedFinished();
-        else
-            runIndexer();
-    });
+    shared_lock lock(index_paths_mutex_);
+    for (const auto &[path, fsp] : index_paths_)
+        visit(*fsp);
+}
+
+bool FsIndex::listDirectories(const QString &dir_path, bool hidden, vector<QString> &names) const
+{
+    shared_lock lock(index_paths_mutex_);
+    for (const auto &[path, fsp] : index_paths_)  // Nested index paths are possible
+        if (dir_path.startsWith(path) && fsp->listDirectories(dir_path, hidden, names))
+            return true;
+    return false;
 }
 
-FsIndex::~FsIndex()
+vector<pair<shared_ptr<FileItem>, double>>
+FsIndex::matchPath(const QStringList &tokens, size_t max_results,
+                   const function<bool()> &cancelled) const
 {
-    future_watcher.disconnect();
-    abort = true;
-    if (future_watcher.isRunning()){
-        WARN << "Busy wait for file indexer.";
-        future_watcher.waitForFinished();
+    vector<pair<shared_ptr<FileItem>, double>> results;
+    {
+        shared_lock lock(index_paths_mutex_);
+        for (const auto &[path, fsp] : index_paths_)
+            fsp->matchPath(tokens, results, max_results, cancelled);
     }
+
+    // Each path contributes its best matches, keep the best of all
+    if (results.size() > max_results)
+    {
+        partial_sort(results.begin(), results.begin() + max_results, results.end(),
+                     [](const auto &l, const auto &r){ return l.second > r.second; });
+        results.resize(max_results);
+    }
+    return results;
 }
 
-const map<QString,unique_ptr<FsIndexPath>> &FsIndex::indexPaths() const
-{ return index_paths_; }
+vector<QString> FsIndex::findContent(const QString &text, size_t max_results,
+                                     const function<bool()> &cancelled) const
+{
+    // Reading the files takes a while, do not block adding and removing paths meanwhile
+    vector<QString> candidates;
+    {
+        shared_lock lock(index_paths_mutex_);
+        for (const auto &[path, fsp] : index_paths_)
+        {
+            auto c = fsp->contentCandidates(text);
+            candidates.insert(candidates.end(),
+                              make_move_iterator(c.begin()), make_move_iterator(c.end()));
+        }
+    }
+    return ContentIndex::verify(candidates, text, max_results, cancelled);
+}
 
 void FsIndex::addPath(unique_ptr<FsIndexPath> fsp)
 {
+    unique_lock lock(index_paths_mutex_);
     const auto &[it, success] = index_paths_.emplace(fsp->path(), ::move(fsp));
+    lock.unlock();
     if (success){
         connect(it->second.get(), &FsIndexPath::updateRequired, this, &FsIndex::updateThreaded);
         updateThreaded(it->second.get());
@@ -44,41 +86,114 @@ void FsIndex::removePath(const QString &path)
         auto &fsp = index_paths_.at(path);
         disconnect(fsp.get(), &FsIndexPath::updateRequired, this, &FsIndex::updateThreaded);
         queue.erase(fsp.get());
-        if (fsp.get() == updating){
-            abort = true;
-            future_watcher.waitForFinished();
+        if (auto it = running.find(fsp.get()); it != running.end()){
+            it->second->future_watcher.disconnect();
+            it->second->abort = true;
+            it->second->future_watcher.waitForFinished();
+            running.erase(it);
+            runIndexer();
         }
+        unique_lock lock(index_paths_mutex_);
         index_paths_.erase(path);
     } catch (const out_of_range&) {
         CRIT << "Logic error: Removed non existing path.";
     }
 }
 
+uint FsIndex::maxConcurrentScans() const { return max_concurrent_scans; }
+
+void FsIndex::setMaxConcurrentScans(uint val)
+{
+    max_concurrent_scans = max(val, 1u);
+    runIndexer();
+}
+
 void FsIndex::updateThreaded(FsIndexPath *p)
 {
-    queue.insert(p);
-    if (updating == p)
-        abort = true;
+    // Do not restart running scans, changes meanwhile are picked up by a subsequent run
+    if (auto it = running.find(p); it != running.end())
+        it->second->rerun = true;
+    else if (queue.find(p) == queue.end())  // else debounced
+        queue[p].start();
     runIndexer();
 }
 
 void FsIndex::runIndexer()
 {
-    if (!future_watcher.isRunning() && !queue.empty()){
-        updating = *queue.begin();
-        queue.erase(queue.begin());
-        INFO << "Indexing" << updating->path();
-        future_watcher.setFuture(QtConcurrent::run([this, fsp=updating](){
-            try{
-                fsp->update(abort, [this](const QString &s){ emit status(s);});
-            } catch(const exception &e){
-                CRIT << "Indexer crashed" << e.what();
-            }
-            abort = false;
-        }));
+    // Informed updates do not wait for slots, full scans may be throttled and paused for long
+    for (auto it = queue.begin(); it != queue.end();)
+        if (!it->first->fullScanPending())
+        {
+            startScan(it->first, false);
+            it = queue.erase(it);
+        }
+        else
+            ++it;
+
+    auto full_scans = (size_t)count_if(running.begin(), running.end(),
+                                       [](const auto &r){ return r.second->full; });
+    for (; full_scans < max_concurrent_scans && !queue.empty(); ++full_scans)
+    {
+        // Highest priority first, then the cheapest. Waiting time offsets the estimated cost
+        // such that expensive paths do not starve behind frequently updated cheap ones.
+        const auto next = min_element(queue.begin(), queue.end(), [](const auto &l, const auto &r){
+            if (l.first->priority() != r.first->priority())
+                return l.first->priority() > r.first->priority();
+            return l.first->estimatedCost() - l.second.elapsed()
+                   < r.first->estimatedCost() - r.second.elapsed();
+        });
+        auto *fsp = next->first;
+        queue.erase(next);
+        startScan(fsp, true);
     }
 }
 
+void FsIndex::startScan(FsIndexPath *fsp, bool full)
+{
+    INFO << QString("Indexing '%1' (estimated %2 ms).").arg(fsp->path()).arg(fsp->estimatedCost());
+
+    auto &scan = running[fsp];
+    scan = make_unique<Scan>();
+    scan->serial = ++scan_serial;
+    scan->full = full;
+    connect(&scan->future_watcher, &QFutureWatcher<void>::finished, this,
+            [this, fsp, serial=scan->serial](){
+        // Calls posted before removePath or stop dropped the scan are stale. fsp may be
+        // destroyed then, it is used as key only.
+        auto it = running.find(fsp);
+        if (it == running.end() || it->second->serial != serial)
+            return;
+        const bool rerun = it->second->rerun;
+        running.erase(it);  // deletes the sender, fine for queued connections
+        if (rerun)
+            queue[fsp].start();
+        runIndexer();
+        emit updatedFinished();
+    }, Qt::QueuedConnection);
+    scan->future_watcher.setFuture(QtConcurrent::run([this, fsp, &abort=scan->abort](){
+        try{
+            fsp->update(abort, [this](const QString &s){ emit status(s);});
+        } catch(const exception &e){
+            CRIT << "Indexer crashed" << e.what();
+        }
+    }));
+}
+
+void FsIndex::stop()
+{
+    queue.clear();
+    for (auto &[fsp, scan] : running){
+        scan->future_watcher.disconnect();
+        scan->abort = true;
+    }
+    for (auto &[fsp, scan] : running)
+        if (scan->future_watcher.isRunning()){
+            WARN << "Busy wait for file indexer.";
+            scan->future_watcher.waitForFinished();
+        }
+    running.clear();
+}
+
 void FsIndex::update(FsIndexPath *p)
 {
     if (p)
@@ -87,4 +202,3 @@ void FsIndex::update(FsIndexPath *p)
         for (auto &[_, fsp] : index_paths_)
             updateThreaded(fsp.get());
 }
-
@@ -2,11 +2,14 @@
 
 #pragma once
 #include "fsindexpath.h"
+#include <QElapsedTimer>
 #include <QFutureWatcher>
 #include <QString>
+#include <functional>
 #include <map>
 #include <memory>
-#include <set>
+#include <shared_mutex>
+#include <vector>
 
 class FsIndex : public QObject
 {
@@ -17,43 +20,60 @@ public:
 
     const std::map<QString, std::unique_ptr<FsIndexPath>> &indexPaths() const;
 
+    /// Calls visit for every index path, holding off removals meanwhile. Thread-safe.
+    void forEachPath(const std::function<void(const FsIndexPath&)> &visit) const;
+
+    /// Lists the subdirectories of the directory at dir_path. Thread-safe.
+    /// @returns false if no index path contains all of them
+    /// @see FsIndexPath::listDirectories
+    bool listDirectories(const QString &dir_path, bool hidden, std::vector<QString> &names) const;
+
+    /// Finds indexed files by the components of their paths. Thread-safe.
+    /// @see FsIndexPath::matchPath
+    std::vector<std::pair<std::shared_ptr<FileItem>, double>>
+    matchPath(const QStringList &tokens, size_t max_results,
+              const std::function<bool()> &cancelled) const;
+
+    /// Finds indexed text files containing text. Thread-safe.
+    std::vector<QString> findContent(const QString &text, size_t max_results,
+                                     const std::function<bool()> &cancelled) const;
+
     void addPath(std::unique_ptr<FsIndexPath> fsp);
     void removePath(const QString &path);
 
     void update(FsIndexPath *p = nullptr);
 
+    /// Aborts running and drops pending updates. Aborted scans record their checkpoints.
+    void stop();
+
+    /// The maximum number of index paths scanned concurrently. Informed updates, i.e. of
+    /// the directories reported by the watcher, are cheap and not limited.
+    uint maxConcurrentScans() const;
+    void setMaxConcurrentScans(uint);
+
 private:
     void updateThreaded(FsIndexPath *p);
     void runIndexer();
-    QFutureWatcher<void> future_watcher;
-    FsIndexPath *updating;
-    std::set<FsIndexPath*> queue;
-    bool abort;
+    void startScan(FsIndexPath *fsp, bool full);
+
+    struct Scan
+    {
+        uint64_t serial;  // identifies the scan in queued calls
+        bool full;  // counts against max_concurrent_scans
+        std::atomic_bool abort = false;
+        bool rerun = false;  // requested while running
+        QFutureWatcher<void> future_watcher;
+    };
+
+    std::map<FsIndexPath*, std::unique_ptr<Scan>> running;
+    std::map<FsIndexPath*, QElapsedTimer> queue;  // waiting since
+    uint max_concurrent_scans;
+    uint64_t scan_serial = 0;
     std::map<QString, std::unique_ptr<FsIndexPath>> index_paths_;  // DO NOT JUST REMOVE
+    // Guards modifications against forEachPath(), listDirectories(), matchPath() and findContent()
+    mutable std::shared_mutex index_paths_mutex_;
 
 signals:
     void status(const QString&);
-    void updatedFinished();
+    void updatedFinished();  // an index path finished updating
 };
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -1,15 +1,31 @@
 // Copyright (c) 2022-2023 Manuel Schneider
 
+#include "contentindex.h"
+#include "dirlisting.h"
 #include "fileitems.h"
 #include "fsindexnodes.h"
+#include "scanthrottle.h"
 #include <QDir>
+#include <QIODevice>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QMimeDatabase>
 #include <QRegularExpression>
 #include <QString>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 using namespace std;
@@ -24,6 +40,66 @@ static const char *JK_ITEMS = "items";
 static QMimeDatabase mdb;
 static QMimeType dirmimetype = mdb.mimeTypeForName(QStringLiteral("inode/directory"));
 
+// deque, references must stay valid while the registry grows
+static shared_mutex mime_types_mutex;
+static deque<QMimeType> mime_types;
+static map<QString, uint16_t> mime_type_ids;
+
+// Guards the contents of nodes against readers on other threads (e.g. periodic persistence)
+// while scanning. Striped, a mutex per node would be too heavy for millions of directories.
+static mutex node_mutexes[64];
+static mutex &nodeMutex(const void *node)
+{ return node_mutexes[(reinterpret_cast<uintptr_t>(node) >> 4) % size(node_mutexes)]; }
+
+namespace {
+
+const char BIN_MAGIC[8] = {'A', 'L', 'B', 'F', 'S', 'I', 'D', 'X'};
+const uint32_t BIN_VERSION = 1;
+const uint32_t BIN_BYTE_ORDER = 0x01020304;
+
+struct BinString
+{
+    uint32_t offset;  // UTF-16 code units
+    uint32_t size;
+};
+
+struct BinHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    BinString path;
+    uint32_t node_count;
+    uint32_t item_count;
+    uint32_t mime_count;
+    uint32_t reserved;
+    uint64_t string_size;  // UTF-16 code units
+};
+
+struct BinNode
+{
+    BinString name;
+    uint32_t mdate;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t first_item;
+    uint32_t item_count;
+    uint32_t reserved;
+};
+
+struct BinItem
+{
+    BinString name;
+    uint32_t mime;
+};
+
+static_assert(sizeof(BinHeader) == 48);
+static_assert(sizeof(BinNode) == 32);
+static_assert(sizeof(BinItem) == 12);
+static_assert(sizeof(BinString) == 8);
+
+}
+
 
 NameFilter::NameFilter(QRegularExpression re, PatternType t) : regex(std::move(re)), type(t) {}
 
@@ -35,6 +111,107 @@ NameFilter::NameFilter(const QString &pattern) : regex(pattern), type(PatternTyp
 }
 
 
+uint16_t MimeTypeRegistry::id(const QMimeType &mime_type)
+{
+    const auto name = mime_type.name();
+
+    {
+        shared_lock lock(mime_types_mutex);
+        if (auto it = mime_type_ids.find(name); it != mime_type_ids.end())
+            return it->second;
+    }
+
+    unique_lock lock(mime_types_mutex);
+    if (mime_types.size() > numeric_limits<uint16_t>::max())
+        throw runtime_error("Mime type registry exhausted.");
+    const auto &[it, inserted] = mime_type_ids.emplace(name, (uint16_t)mime_types.size());
+    if (inserted)
+        mime_types.emplace_back(mime_type);
+    return it->second;
+}
+
+const QMimeType &MimeTypeRegistry::mimeType(uint16_t id)
+{
+    shared_lock lock(mime_types_mutex);
+    return mime_types.at(id);
+}
+
+uint16_t MimeTypeRegistry::idForFileName(const QString &file_name)
+{
+    // Not cached per suffix, whole name globs (CMakeLists.txt) take precedence over suffixes
+    return id(mdb.mimeTypeForFile(file_name, QMimeDatabase::MatchExtension));
+}
+
+// Subtrees up to this depth are recorded in checkpoints, the root has depth 1. Deeper
+// directories are covered by their ancestor, such that recording is rare.
+static const uint CHECKPOINT_DEPTH = 3;
+
+// Records the subtree of a directory in the checkpoint once the directory and all its
+// descendants have been scanned. Subtrees scanned by other threads hold a reference.
+struct SubtreeScan
+{
+    const shared_ptr<SubtreeScan> parent;
+    const shared_ptr<DirNode> node;
+    IndexState &state;
+    const bool resuming;  // the checkpoint contains completed descendants
+
+    ~SubtreeScan()
+    {
+        if (state.abort.load(memory_order_relaxed))
+            return;
+
+        // Completed descendants are covered by this subtree
+        const auto relative_path = node->relativeFilePath();
+        const auto prefix = relative_path + u'/';
+        lock_guard lock(state.checkpoint->mutex);
+        auto &completed = state.checkpoint->completed;
+        for (auto it = completed.lower_bound(prefix);
+             it != completed.end() && it->startsWith(prefix);)
+            it = completed.erase(it);
+        completed.insert(relative_path);
+    }
+};
+
+// Whether the contents of files of a mime type are indexed
+static bool isText(uint16_t mime)
+{
+    static shared_mutex mutex;
+    static unordered_map<uint16_t, bool> text;
+    {
+        shared_lock lock(mutex);
+        if (auto it = text.find(mime); it != text.end())
+            return it->second;
+    }
+    const bool is_text = MimeTypeRegistry::mimeType(mime).inherits(QStringLiteral("text/plain"));
+    unique_lock lock(mutex);
+    text.emplace(mime, is_text);
+    return is_text;
+}
+
+// Unknown types are left unresolved in lazy mode if defer is set
+static uint16_t resolveMimeType(const DirEntry &entry, const QString &file_path,
+                                MimeResolution resolution, bool defer)
+{
+    if (entry.is_dir)
+        return MimeTypeRegistry::id(dirmimetype);
+
+    switch (resolution) {
+    case MimeResolution::Content:
+        return MimeTypeRegistry::id(mdb.mimeTypeForFile(file_path));
+    case MimeResolution::Lazy:
+        if (auto id = MimeTypeRegistry::idForFileName(entry.name);
+            !MimeTypeRegistry::mimeType(id).isDefault())
+            return id;
+        if (!defer)
+            return MimeTypeRegistry::id(mdb.mimeTypeForFile(file_path, QMimeDatabase::MatchContent));
+        return MimeTypeRegistry::id(QMimeType());  // unresolved, see IndexFileItem::mimeType
+    case MimeResolution::Extension:
+    default:
+        return MimeTypeRegistry::idForFileName(entry.name);
+    }
+}
+
+
 DirNode::DirNode(QString name, const std::shared_ptr<DirNode>& parent, uint64_t mdate):
         parent_(parent), name_(std::move(name)), mdate_(mdate) { name_.shrink_to_fit(); }
 
@@ -55,11 +232,12 @@ shared_ptr<DirNode> DirNode::fromJson(const QJsonObject &json, const std::shared
 
     for (const auto &json_value : json[JK_ITEMS].toArray()){
         auto json_item = json_value.toObject();
-        d->items_.emplace_back(make_shared<IndexFileItem>(json_item[JK_NAME].toString(),
-                                                          mdb.mimeTypeForName(json_item[JK_MIME].toString()), d));
+        d->addItem(json_item[JK_NAME].toString(),
+                   MimeTypeRegistry::id(mdb.mimeTypeForName(json_item[JK_MIME].toString())));
     }
 
     d->children_.shrink_to_fit();
+    d->item_names_.squeeze();
     d->items_.shrink_to_fit();
     return d;
 }
@@ -78,8 +256,8 @@ QJsonObject DirNode::toJson() const
     QJsonArray json_items;
     for (const auto &item : items_){
         QJsonObject json_item;
-        json_item.insert(JK_NAME, item->name());
-        json_item.insert(JK_MIME, item->mimeType().name());
+        json_item.insert(JK_NAME, itemName(item).toString());
+        json_item.insert(JK_MIME, MimeTypeRegistry::mimeType(item.mime).name());
         json_items.push_back(json_item);
     }
     json.insert(JK_ITEMS, json_items);
@@ -89,105 +267,200 @@ QJsonObject DirNode::toJson() const
 
 void DirNode::removeChildren()
 {
-    for (auto &child : children_)
+    vector<shared_ptr<DirNode>> children;
+    {
+        lock_guard lock(nodeMutex(this));
+        children.swap(children_);
+    }
+    for (auto &child : children)
         child->removeChildren();
-    children_.clear();
+}
+
+void DirNode::markDirty()
+{
+    lock_guard lock(nodeMutex(this));
+    mdate_ = 0;
 }
 
 void DirNode::update(const std::shared_ptr<DirNode>& shared_this,
-                     const bool &abort,
-                     std::function<void(const QString&)> &status,
                      const IndexSettings &settings,
-                     std::set<QString> &indexed_dirs,
-                     uint depth)
+                     IndexState &state,
+                     uint depth,
+                     const shared_ptr<SubtreeScan> &parent_scan)
 {
-    if (abort)
+    if (state.abort.load(memory_order_relaxed))
         return;
 
-    const QFileInfo fileInfo(filePath());
+    auto scan = parent_scan;
+    if (state.checkpoint && depth <= CHECKPOINT_DEPTH)
+    {
+        // Skip subtrees completed by an interrupted scan
+        bool resuming = parent_scan ? parent_scan->resuming : true;
+        if (resuming)
+        {
+            const auto relative_path = relativeFilePath();
+            const auto prefix = relative_path + u'/';
+            bool completed_subtree;
+            {
+                lock_guard lock(state.checkpoint->mutex);
+                const auto &completed = state.checkpoint->completed;
+                completed_subtree = completed.count(relative_path);
+                const auto it = completed.lower_bound(prefix);
+                resuming = it != completed.end() && it->startsWith(prefix);
+            }
+
+            // Rescan completed subtrees whose root has been modified meanwhile. Note that
+            // modifications further down are not detected, mdates do not propagate upwards.
+            if (completed_subtree)
+            {
+                if (FileStat stat; statFile(filePath(), stat) && stat.mtime <= mdate_)
+                    return;
+                resuming = false;
+            }
+        }
+        scan.reset(new SubtreeScan{parent_scan, shared_this, state, resuming});
+    }
+
+    const auto file_path = filePath();
+
+    FileStat stat;
+    if (statFile(file_path, stat))
+    {
+        // Skip if this dir has already been indexed (loop detection)
+        lock_guard lock(state.mutex);
+        if (const auto &[it, success] = state.indexed_dirs.emplace(stat.id); !success)
+            return;
+    }
+    else
+        stat.mtime = 0;  // Vanished, the listing will be empty
 
-    // Skip if this dir has already been indexed (loop detection)
-    if (const auto &[it, success] = indexed_dirs.emplace(fileInfo.canonicalFilePath()); !success)
+    // Loops do not count against the rate
+    if (state.throttle && !state.throttle->acquire(state.abort))
         return;
 
-    auto mdate = (uint64_t)fileInfo.lastModified().toSecsSinceEpoch();
+    auto mdate = stat.mtime;
 
     if (settings.forced || mdate_ < mdate) {
-        mdate_ = mdate;
+        state.changed = true;
 
-        QString absFilePath = fileInfo.absoluteFilePath();
-        status(QString("Indexing %1").arg(fileInfo.filePath()));
+        state.status(QString("Indexing %1").arg(file_path));
 
-        auto filters = QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot;
-        if (settings.index_hidden_files)
-            filters |= QDir::Hidden;
+        // Subtrees are updated after the merge, such that they can be scanned in parallel
+        vector<shared_ptr<DirNode>> dirty_children;
 
-        auto cit = children_.begin();
-        auto iit = items_.begin();
-        for (const auto &fi : QDir(absFilePath).entryInfoList(filters, QDir::Name)) {
+        // The merge result is built aside and swapped in, such that readers never block on
+        // I/O. Items are rebuilt from the listing. Note that published items keep sharing the
+        // previous name buffer.
+        auto children = children_;
+        QString item_names;
+        vector<ItemEntry> items;
+        vector<QString> text_files;
 
-            // Erase children and items which do not exists anymore (until this lexicographic point)
-            while (cit != children_.end() && (*cit)->name_ < fi.fileName())
-                cit = children_.erase(cit);
-            while (iit != items_.end() && (*iit)->name() < fi.fileName())
-                iit = items_.erase(iit);
+        // Entry paths are built in place, the buffer is reused for all entries
+        QString entry_path = file_path + u'/';
+        const auto dir_path_size = entry_path.size();
+
+        auto cit = children.begin();
+        for (const auto &entry : listDirectory(file_path, settings.index_hidden_files)) {
+
+            // Erase children which do not exists anymore (until this lexicographic point)
+            while (cit != children.end() && (*cit)->name_ < entry.name)
+                cit = children.erase(cit);
+
+            entry_path.truncate(dir_path_size);
+            entry_path.append(entry.name);
 
             // Match against name filters
-            auto exclude = false;
-            auto relative_path = fi.filePath().mid(settings.root_path.length()+1);
-            for (const auto &filter: settings.name_filters)
-                if (((exclude && filter.type == PatternType::Include) || (!exclude && filter.type == PatternType::Exclude))
-                    && filter.regex.match(relative_path).hasMatch())
-                    exclude = !exclude;
+            const auto exclude = settings.name_filters.excludes(
+                QStringView(entry_path).mid(settings.root_path.length()+1));
 
             // Index structure
-            if (fi.isDir()) {
-                auto is_indexed = cit != children_.end() && (*cit)->name_ == fi.fileName();
-                if (exclude || settings.max_depth < depth || (fi.isSymLink() && !settings.follow_symlinks)){
+            if (entry.is_dir) {
+                auto is_indexed = cit != children.end() && (*cit)->name_ == entry.name;
+                if (exclude || settings.max_depth < depth || (entry.is_symlink && !settings.follow_symlinks)){
                     if (is_indexed) {
                         (*cit)->removeChildren();
-                        cit = children_.erase(cit);
+                        cit = children.erase(cit);
                     }
                 } else {
                     if (!is_indexed)
-                        cit = children_.emplace(cit, DirNode::make(fi.fileName(), shared_this));
-                    (*cit)->update(*cit, abort, status, settings, indexed_dirs, depth+1);  // UPDATE new directories always
+                    {
+                        cit = children.emplace(cit, DirNode::make(entry.name, shared_this));
+                        if (state.new_dirs)
+                        {
+                            lock_guard lock(state.mutex);
+                            state.new_dirs->append(entry_path);
+                        }
+                    }
+                    if (settings.scan_mode || !is_indexed)
+                        dirty_children.emplace_back(*cit);  // UPDATE new directories always
                     ++cit;
                 }
             }
 
-            // Items
-            auto mime_type = mdb.mimeTypeForFile(fi);
-            exclude = none_of(settings.mime_filters.begin(), settings.mime_filters.end(),
-                               [mt = mime_type.name()](const QRegularExpression &re) {
-                                   return re.match(mt).hasMatch();
-                               }) || exclude || settings.max_depth < depth;
-            if (iit != items_.end() && (*iit)->name() == fi.fileName()) {  // _is_ already indexed
-                if (exclude)
-                    iit = items_.erase(iit);
-                else ++iit;
-            } else {  // is _not_ indexed yet
-                if (!(exclude)) {
-                    iit = items_.emplace(iit, make_shared<IndexFileItem>(fi.fileName(), mime_type, shared_this));
-                    ++iit;
-                }
-            }
+            // Items. Mime types of excluded entries are not needed.
+            if (exclude || settings.max_depth < depth)
+                continue;
+
+            // Filters and content index need the actual types of the items
+            const auto mime = resolveMimeType(entry, entry_path, settings.mime_resolution,
+                                              settings.mime_filters_match_all && !state.content_index);
+            if (state.content_index && !entry.is_dir && isText(mime))
+                text_files.emplace_back(entry.name);
+            const auto &mime_type = MimeTypeRegistry::mimeType(mime);
+            const auto mime_name = mime_type.isValid() ? mime_type.name()
+                                                       : QStringLiteral("application/octet-stream");
+            if (any_of(settings.mime_filters.begin(), settings.mime_filters.end(),
+                       [&](const QRegularExpression &re) { return re.match(mime_name).hasMatch(); }))
+                addItem(item_names, items, entry.name, mime);
         }
 
         // Remaining entries have no corresponding physical file. delete.
-        while (cit != children_.end())
-            cit = children_.erase(cit);
-        while (iit != items_.end())
-            iit = items_.erase(iit);
+        children.erase(cit, children.end());
+
+        children.shrink_to_fit();
+        item_names.squeeze();
+        items.shrink_to_fit();
+
+        {
+            lock_guard lock(nodeMutex(this));
+            children_.swap(children);
+            item_names_.swap(item_names);
+            items_.swap(items);
+            mdate_ = mdate;
+        }
+
+        if (state.content_index)
+            state.content_index->updateDirectory(file_path, relativeFilePath(), text_files);
 
-        children_.shrink_to_fit();
-        items_.shrink_to_fit();
+        updateChildren(dirty_children, settings, state, depth+1, scan);
+
+    } else if (settings.scan_mode) {
+        // Not dirty or forced. Modified files do not change the mdate of their directory.
+        if (state.content_index)
+            state.content_index->refreshDirectory(file_path, relativeFilePath());
 
-    } else {
-        // Not dirty or forced
         // Check children anyway because mdates dont propagate upwards
-        for (auto &child : children_)
-            child->update(child, abort, status, settings, indexed_dirs, depth+1);
+        updateChildren(children_, settings, state, depth+1, scan);
+    }
+}
+
+void DirNode::updateChildren(const vector<shared_ptr<DirNode>> &children,
+                             const IndexSettings &settings,
+                             IndexState &state,
+                             uint depth,
+                             const shared_ptr<SubtreeScan> &scan)
+{
+    for (const auto &child : children)
+    {
+        // Hand subtrees to idle threads, descend into the others right here. Each task merges
+        // its own directory only, therefore the sorted merge needs no further synchronization.
+        if (state.pool && state.pool->activeThreadCount() < state.pool->maxThreadCount())
+            state.pool->start([child, &settings, &state, depth, scan]{
+                child->update(child, settings, state, depth, scan);
+            });
+        else
+            child->update(child, settings, state, depth, scan);
     }
 }
 
@@ -197,22 +470,153 @@ QString DirNode::filePath() const { return parent_->filePath().append("/").appen
 
 QString DirNode::relativeFilePath() const { return parent_->relativeFilePath().append("/").append(name_); }
 
+void DirNode::addItem(QStringView name, uint16_t mime) { addItem(item_names_, items_, name, mime); }
+
+void DirNode::addItem(QString &names, vector<ItemEntry> &items, QStringView name, uint16_t mime)
+{
+    items.push_back({(uint32_t)names.size(), (uint16_t)name.size(), mime});
+    names.append(name);
+}
+
+QStringView DirNode::itemName(const ItemEntry &item) const
+{ return QStringView(item_names_).mid(item.name_offset, item.name_size); }
+
 void DirNode::items(std::vector<std::shared_ptr<FileItem>> &result) const
 {
-    for (const auto &item : items_)
-        result.emplace_back(item);
-    for (const auto &child : children_)
+    // File items are materialized on demand only
+    const auto self = shared_from_this();
+    vector<shared_ptr<DirNode>> children;
+    {
+        lock_guard lock(nodeMutex(this));
+        for (const auto &item : items_)
+            result.emplace_back(make_shared<IndexFileItem>(self, item_names_, item.name_offset,
+                                                           item.name_size, item.mime));
+        children = children_;
+    }
+    for (const auto &child : children)
         child->items(result);
 }
 
 void DirNode::nodes(std::vector<std::shared_ptr<DirNode>> &result) const
 {
-    for (const auto &child : children_){
+    vector<shared_ptr<DirNode>> children;
+    {
+        lock_guard lock(nodeMutex(this));
+        children = children_;
+    }
+    for (const auto &child : children){
         result.emplace_back(child);
         child->nodes(result);
     }
 }
 
+void DirNode::entries(vector<DirEntry> &result) const
+{
+    for (const auto &child : children_)
+        result.push_back({child->name_, true, false});
+
+    // Directory items are either children or excluded from the tree (e.g. max depth)
+    const auto dir_mime = MimeTypeRegistry::id(dirmimetype);
+    for (const auto &item : items_)
+    {
+        const auto name = itemName(item);
+        if (item.mime != dir_mime)
+            result.push_back({name.toString(), false, false});
+        else if (auto it = lower_bound(children_.begin(), children_.end(), name,
+                                       [](const auto &child, QStringView n){ return QStringView(child->name_) < n; });
+                 it == children_.end() || QStringView((*it)->name_) != name)
+            result.push_back({name.toString(), true, false});
+    }
+}
+
+NameIndex::NameIndex(const shared_ptr<const DirNode> &root)
+{
+    vector<shared_ptr<DirNode>> nodes;
+    root->nodes(nodes);
+
+    const auto add = [this](const shared_ptr<const DirNode> &node)
+    {
+        lock_guard lock(nodeMutex(node.get()));
+        if (node->items_.empty())
+            return;
+        const auto dir = (uint32_t)dirs_.size();
+        dirs_.emplace_back(node, node->item_names_);
+        for (const auto &item : node->items_)
+            if (item.name_size)
+                entries_[QChar(node->item_names_[item.name_offset]).toCaseFolded().unicode()]
+                    .push_back({dir, item.name_offset, item.name_size, item.mime});
+    };
+
+    add(root);
+    for (const auto &node : nodes)
+        add(node);
+}
+
+QStringView NameIndex::name(const Entry &entry) const
+{ return QStringView(dirs_[entry.dir].second).mid(entry.name_offset, entry.name_size); }
+
+void NameIndex::matchPath(const QStringList &tokens, qsizetype matched,
+                          vector<pair<shared_ptr<FileItem>, double>> &results,
+                          size_t max_results, const function<bool()> &cancelled) const
+{
+    const auto &last = tokens.back();
+    if (last.isEmpty())
+        return;
+    const auto it = entries_.find(last.front().toCaseFolded().unicode());
+    if (it == entries_.end())
+        return;
+
+    vector<pair<const Entry*, double>> matches;
+    for (size_t i = 0; i < it->second.size(); ++i)
+    {
+        if (i % 1024 == 0 && cancelled())
+            return;
+
+        const auto &entry = it->second[i];
+        const auto entry_name = name(entry);
+        if (!entry_name.startsWith(last, Qt::CaseInsensitive))
+            continue;
+
+        // Match the remaining tokens backwards, greedily. The root path takes the rest.
+        auto k = tokens.size() - 1;
+        for (auto *node = dirs_[entry.dir].first.get(); k > matched && node->parent_;
+             node = node->parent_.get())
+            if (node->name_.startsWith(tokens[k - 1], Qt::CaseInsensitive))
+                --k;
+
+        if (k <= matched)
+            matches.emplace_back(&entry, (double)last.size() / entry_name.size());
+    }
+
+    // Rank before capping. File items are materialized for the results only.
+    const auto count = min(max_results, matches.size());
+    partial_sort(matches.begin(), matches.begin() + count, matches.end(),
+                 [](const auto &l, const auto &r){ return l.second > r.second; });
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto &[entry, score] = matches[i];
+        const auto &[dir, names] = dirs_[entry->dir];
+        results.emplace_back(make_shared<IndexFileItem>(dir, names, entry->name_offset,
+                                                        entry->name_size, entry->mime),
+                             score);
+    }
+}
+
+shared_ptr<DirNode> DirNode::node(const QString &relative_path) const
+{
+    auto node = const_pointer_cast<DirNode>(shared_from_this());
+    for (const auto &name : QStringView(relative_path).split(u'/', Qt::SkipEmptyParts))
+    {
+        // Children are sorted by name
+        auto it = lower_bound(node->children_.begin(), node->children_.end(), name,
+                              [](const auto &child, QStringView n){ return QStringView(child->name_) < n; });
+        if (it == node->children_.end() || QStringView((*it)->name_) != name)
+            return nullptr;
+        node = *it;
+    }
+    return node;
+}
+
 QMimeType DirNode::dirMimeType() {return dirmimetype; }
 
 
@@ -244,12 +648,13 @@ std::shared_ptr<RootNode> RootNode::fromJson(const QJsonObject &json)
 
     for (const auto &json_value : json[JK_ITEMS].toArray()){
         auto json_item = json_value.toObject();
-        n->items_.emplace_back(make_shared<IndexFileItem>(json_item[JK_NAME].toString(),
-                                                          mdb.mimeTypeForName(json_item[JK_MIME].toString()), n));
+        n->addItem(json_item[JK_NAME].toString(),
+                   MimeTypeRegistry::id(mdb.mimeTypeForName(json_item[JK_MIME].toString())));
     }
 
     n->path_.shrink_to_fit();
     n->children_.shrink_to_fit();
+    n->item_names_.squeeze();
     n->items_.shrink_to_fit();
     return n;
 }
@@ -261,8 +666,214 @@ QJsonObject RootNode::toJson() const
     return json;
 }
 
+shared_ptr<RootNode> RootNode::fromBinary(const uchar *data, qint64 size)
+{
+    if (size < (qint64)sizeof(BinHeader))
+        throw runtime_error("Index data too small.");
+
+    const auto *header = reinterpret_cast<const BinHeader*>(data);
+    if (memcmp(header->magic, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0)
+        throw runtime_error("Index data has no valid magic number.");
+    if (header->version != BIN_VERSION)
+        throw runtime_error(QString("Unsupported index version: %1.").arg(header->version).toStdString());
+    if (header->byte_order != BIN_BYTE_ORDER)
+        throw runtime_error("Index data has foreign byte order.");
+    if (header->node_count == 0)
+        throw runtime_error("Index data has no root node.");
+
+    const uint64_t nodes_offset = sizeof(BinHeader);
+    const uint64_t items_offset = nodes_offset + (uint64_t)header->node_count * sizeof(BinNode);
+    const uint64_t mimes_offset = items_offset + (uint64_t)header->item_count * sizeof(BinItem);
+    const uint64_t strings_offset = mimes_offset + (uint64_t)header->mime_count * sizeof(BinString);
+    if (strings_offset + header->string_size * sizeof(char16_t) > (uint64_t)size)
+        throw runtime_error("Index data truncated.");
+
+    const auto *nodes = reinterpret_cast<const BinNode*>(data + nodes_offset);
+    const auto *items = reinterpret_cast<const BinItem*>(data + items_offset);
+    const auto *mimes = reinterpret_cast<const BinString*>(data + mimes_offset);
+    const auto *strings = reinterpret_cast<const QChar*>(data + strings_offset);
+
+    auto view = [&](const BinString &s)
+    {
+        if ((uint64_t)s.offset + s.size > header->string_size)
+            throw runtime_error("String reference out of bounds.");
+        return QStringView(strings + s.offset, s.size);
+    };
+
+    auto string = [&](const BinString &s) { return view(s).toString(); };
+
+    // Resolve every distinct mime type once
+    vector<uint16_t> mime_ids;
+    mime_ids.reserve(header->mime_count);
+    for (uint32_t i = 0; i < header->mime_count; ++i)
+        mime_ids.emplace_back(MimeTypeRegistry::id(mdb.mimeTypeForName(string(mimes[i]))));
+
+    auto n = make(string(nodes[0].name));
+    n->path_ = string(header->path);
+    n->path_.shrink_to_fit();
+
+    // Breadth first, parents are always built before their children
+    vector<shared_ptr<DirNode>> built(header->node_count);
+    built[0] = n;
+    for (uint32_t i = 0; i < header->node_count; ++i)
+    {
+        const auto &bn = nodes[i];
+        const auto &d = built[i];
+
+        if (!d)
+            throw runtime_error("Orphaned node in index data.");
+        if (bn.child_count && (bn.first_child <= i
+                               || (uint64_t)bn.first_child + bn.child_count > header->node_count))
+            throw runtime_error("Child range out of bounds.");
+        if ((uint64_t)bn.first_item + bn.item_count > header->item_count)
+            throw runtime_error("Item range out of bounds.");
+
+        d->mdate_ = bn.mdate;
+
+        d->children_.reserve(bn.child_count);
+        for (uint32_t c = bn.first_child; c < bn.first_child + bn.child_count; ++c)
+        {
+            if (built[c])
+                throw runtime_error("Node referenced twice in index data.");
+            built[c] = shared_ptr<DirNode>(new DirNode(string(nodes[c].name), d));
+            d->children_.emplace_back(built[c]);
+        }
+
+        d->items_.reserve(bn.item_count);
+        for (uint32_t j = bn.first_item; j < bn.first_item + bn.item_count; ++j)
+        {
+            if (items[j].mime >= header->mime_count)
+                throw runtime_error("Mime type reference out of bounds.");
+            d->addItem(view(items[j].name), mime_ids[items[j].mime]);
+        }
+        d->item_names_.squeeze();
+
+        built[i].reset();  // Drop the extra reference early
+    }
+
+    return n;
+}
+
+void RootNode::toBinary(QIODevice &device) const
+{
+    // Nodes may be scanned meanwhile. Keep them alive and read each one consistently.
+    vector<shared_ptr<const DirNode>> queue{shared_from_this()};
+    vector<BinNode> bin_nodes;
+    vector<BinItem> bin_items;
+    vector<BinString> bin_mimes;
+    map<uint16_t, uint32_t> mime_ids;  // registry id > table index
+    QString strings;
+
+    auto addString = [&strings](QStringView s)
+    {
+        BinString bs{(uint32_t)strings.size(), (uint32_t)s.size()};
+        strings.append(s);
+        return bs;
+    };
+
+    BinHeader header{};
+    memcpy(header.magic, BIN_MAGIC, sizeof(BIN_MAGIC));
+    header.version = BIN_VERSION;
+    header.byte_order = BIN_BYTE_ORDER;
+    header.path = addString(path_);
+
+    // Breadth first. Note that the queue grows while iterating.
+    for (size_t i = 0; i < queue.size(); ++i)
+    {
+        const auto d = ::move(queue[i]);
+        lock_guard lock(nodeMutex(d.get()));
+
+        BinNode bn{};
+        bn.name = addString(d->name_);
+        bn.mdate = d->mdate_;
+        bn.first_child = (uint32_t)queue.size();
+        bn.child_count = (uint32_t)d->children_.size();
+        bn.first_item = (uint32_t)bin_items.size();
+        bn.item_count = (uint32_t)d->items_.size();
+        bin_nodes.emplace_back(bn);
+
+        for (const auto &child : d->children_)
+            queue.emplace_back(child);
+
+        for (const auto &item : d->items_)
+        {
+            const auto &[it, inserted] = mime_ids.emplace(item.mime, (uint32_t)bin_mimes.size());
+            if (inserted)
+                bin_mimes.emplace_back(addString(MimeTypeRegistry::mimeType(item.mime).name()));
+            bin_items.push_back({addString(d->itemName(item)), it->second});
+        }
+    }
+
+    header.node_count = (uint32_t)bin_nodes.size();
+    header.item_count = (uint32_t)bin_items.size();
+    header.mime_count = (uint32_t)bin_mimes.size();
+    header.string_size = (uint64_t)strings.size();
+
+    device.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    device.write(reinterpret_cast<const char*>(bin_nodes.data()), bin_nodes.size() * sizeof(BinNode));
+    device.write(reinterpret_cast<const char*>(bin_items.data()), bin_items.size() * sizeof(BinItem));
+    device.write(reinterpret_cast<const char*>(bin_mimes.data()), bin_mimes.size() * sizeof(BinString));
+    device.write(reinterpret_cast<const char*>(strings.utf16()), strings.size() * sizeof(char16_t));
+}
+
 QString RootNode::path() const { return path_; }
 
 QString RootNode::filePath() const { return QString("%1/%2").arg(path_, name_); }
 
 QString RootNode::relativeFilePath() const { return {}; }
+
+vector<shared_ptr<DirNode>> RootNode::sweep(IndexState &state, int threads)
+{
+    struct Entry
+    {
+        shared_ptr<DirNode> node;
+        uint depth;
+        FileStat stat;
+        bool exists;
+    };
+
+    // Snapshot the tree in pre-order. Depths delimit the subtrees.
+    vector<Entry> entries;
+    vector<pair<shared_ptr<DirNode>, uint>> stack{{shared_from_this(), 0}};
+    while (!stack.empty())
+    {
+        auto [node, depth] = ::move(stack.back());
+        stack.pop_back();
+        {
+            lock_guard lock(nodeMutex(node.get()));
+            for (auto it = node->children_.rbegin(); it != node->children_.rend(); ++it)
+                stack.emplace_back(*it, depth + 1);
+        }
+        entries.push_back({::move(node), depth, {}, false});
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QtConcurrent::blockingMap(&pool, entries, [&state](Entry &entry){
+        if (!state.abort.load(memory_order_relaxed))
+            entry.exists = statFile(entry.node->filePath(), entry.stat);
+    });
+
+    vector<shared_ptr<DirNode>> modified;
+    if (state.abort.load(memory_order_relaxed))
+        return modified;
+
+    // Same semantics as update(), which skips looping subtrees and registers merged
+    // directories itself. Vanished directories are removed by the merge of their parent.
+    lock_guard lock(state.mutex);
+    auto skip_depth = numeric_limits<uint>::max();
+    for (auto &entry : entries)
+    {
+        if (entry.depth > skip_depth)
+            continue;
+        skip_depth = numeric_limits<uint>::max();
+
+        if (!entry.exists)
+            continue;
+        else if (entry.node->mdate_ < entry.stat.mtime)
+            modified.emplace_back(::move(entry.node));
+        else if (!state.indexed_dirs.emplace(entry.stat.id).second)
+            skip_depth = entry.depth;
+    }
+    return modified;
+}
@@ -1,15 +1,27 @@
 // Copyright (c) 2022 Manuel Schneider
 
 #pragma once
+#include "dirlisting.h"
+#include "namefiltermatcher.h"
 #include <QFileSystemWatcher>
 #include <QFutureWatcher>
 #include <QRegularExpression>
+#include <QStringList>
 #include <QTimer>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
-class IndexFileItem;
 class FileItem;
+class QIODevice;
 class QMimeType;
+class QThreadPool;
+class ContentIndex;
+class ScanThrottle;
+struct SubtreeScan;
 
 
 enum class PatternType { Include, Exclude };
@@ -23,22 +35,71 @@ struct NameFilter {
 };
 
 
+// How the mime types of files are determined
+enum class MimeResolution : uint8_t
+{
+    Extension,  // file name only, no I/O
+    Lazy,  // file name, content of unknown types is sniffed if the filters depend on it
+    Content  // file name and content
+};
+
+
 struct IndexSettings
 {
     QString root_path;
-    std::vector<NameFilter> name_filters;
+    NameFilterMatcher name_filters;
     std::vector<QRegularExpression> mime_filters;
     uint8_t max_depth;
     bool index_hidden_files;
     bool follow_symlinks;
     bool forced;
+    MimeResolution mime_resolution = MimeResolution::Content;
+    bool mime_filters_match_all = false;  // items do not depend on their mime types
     // uninformed update (scan)
-    // traverse the entire tree anyway, because child dirs may have been modified
-    bool scan_mode = true; // Todo use this for future filesystem watches(false)
+    // traverse the entire tree anyway, because child dirs may have been modified.
+    // informed updates (watches) descend into new directories only.
+    bool scan_mode = true;
+};
+
+
+// Progress of a full scan, such that an interrupted scan can be resumed
+struct Checkpoint
+{
+    std::mutex mutex;
+    size_t settings_hash = 0;  // settings the subtrees have been scanned with
+    std::set<QString> completed;  // relative paths of completed subtrees, guarded by mutex
+};
+
+
+// Mutable state shared by all directories of a scan
+struct IndexState
+{
+    const std::atomic_bool &abort;  // set by another thread, read by the pool threads
+    std::function<void(const QString&)> &status;
+    std::unordered_set<FileId, FileIdHash> indexed_dirs;  // loop detection
+    std::mutex mutex;  // guards indexed_dirs
+    QThreadPool *pool = nullptr;  // scans subtrees in parallel if set
+    QStringList *new_dirs = nullptr;  // collects paths of added directories if set, guarded by mutex
+    std::atomic_bool changed = false;  // set if any directory has been merged
+    Checkpoint *checkpoint = nullptr;  // full scans only, skips and records completed subtrees
+    ScanThrottle *throttle = nullptr;  // limits the rate of throttled scans if set
+    ContentIndex *content_index = nullptr;  // indexes the contents of text files if set
+};
+
+
+// Interns mime types. Ids are stable for the lifetime of the process.
+class MimeTypeRegistry
+{
+public:
+    static uint16_t id(const QMimeType &mime_type);
+    static const QMimeType &mimeType(uint16_t id);
+
+    // Matches the file name only
+    static uint16_t idForFileName(const QString &file_name);
 };
 
 
-class DirNode
+class DirNode : public std::enable_shared_from_this<DirNode>
 {
 public:
     virtual ~DirNode();
@@ -50,12 +111,12 @@ public:
     QJsonObject toJson() const;
 
     void removeChildren();
+    void markDirty();
     void update(const std::shared_ptr<DirNode>& shared_this,
-                const bool &abort,
-                std::function<void(const QString&)> &status,
                 const IndexSettings &settings,
-                std::set<QString> &indexed_dirs,
-                uint depth);
+                IndexState &state,
+                uint depth,
+                const std::shared_ptr<SubtreeScan> &parent_scan = nullptr);
 
     virtual QString path() const;
     virtual QString filePath() const;
@@ -63,6 +124,7 @@ public:
     
     void items(std::vector<std::shared_ptr<FileItem>>&) const;
     void nodes(std::vector<std::shared_ptr<DirNode>>&) const;
+    void entries(std::vector<DirEntry>&) const;  // indexed subdirectories and items
     std::shared_ptr<DirNode> node(const QString &relative_path) const;
 
     static QMimeType dirMimeType();
@@ -74,11 +136,37 @@ protected:
     DirNode &operator=(DirNode&&) = delete;
     DirNode &operator=(const DirNode&) = delete;
 
+    friend class RootNode;
+    friend class NameIndex;
+
+    // Compact file entry. Names of all items of a directory are packed into item_names_.
+    struct ItemEntry
+    {
+        uint32_t name_offset;
+        uint16_t name_size;
+        uint16_t mime;
+    };
+
+    void addItem(QStringView name, uint16_t mime);
+    static void addItem(QString &names, std::vector<ItemEntry> &items,
+                        QStringView name, uint16_t mime);
+    QStringView itemName(const ItemEntry &) const;
+
+    static void updateChildren(const std::vector<std::shared_ptr<DirNode>> &children,
+                               const IndexSettings &settings,
+                               IndexState &state,
+                               uint depth,
+                               const std::shared_ptr<SubtreeScan> &scan);
+
+    // Children, items and mdate are modified by the scanning thread only, while holding the
+    // node mutex (see fsindexnodes.cpp). Readers on other threads lock it as well.
+
     const std::shared_ptr<DirNode> parent_;
     QString name_;
     uint32_t mdate_;
     std::vector<std::shared_ptr<DirNode>> children_;
-    std::vector<std::shared_ptr<IndexFileItem>> items_;
+    QString item_names_;
+    std::vector<ItemEntry> items_;
 };
 
 
@@ -91,6 +179,38 @@ public:
     static std::shared_ptr<RootNode> fromJson(const QJsonObject&);
     QJsonObject toJson() const;
 
+    ///
+    /// Binary index format
+    ///
+    /// A header followed by a node table, an item table, a mime type table
+    /// and a string table. Integers are native endian, strings are UTF-16.
+    /// Nodes are stored breadth first, hence the children of a node are a
+    /// contiguous range in the node table and so are its items in the item
+    /// table. All tables are 4 byte aligned such that they can be read in
+    /// place from a memory mapped file.
+    ///
+    /// The tree is built eagerly in a single pass over the tables. Names are
+    /// copied, such that the mapping can be released afterwards. Lazily built
+    /// subtrees would not pay off, since the index items and the watches need
+    /// all nodes right after loading.
+    ///
+    /// @throws runtime_error if the data is malformed or of another version
+    ///
+    static std::shared_ptr<RootNode> fromBinary(const uchar *data, qint64 size);
+    void toBinary(QIODevice &device) const;
+
+    ///
+    /// Stats all directories of the tree in parallel
+    ///
+    /// Modifications do not change the mdates of the ancestors, hence a full
+    /// scan has to stat every directory. Doing this upfront in parallel spares
+    /// the sequential traversal. Unmodified directories are registered for loop
+    /// detection, such that informed updates of the modified ones can follow.
+    ///
+    /// @returns the modified directories in pre-order
+    ///
+    std::vector<std::shared_ptr<DirNode>> sweep(IndexState &state, int threads);
+
     QString path() const override;
     QString filePath() const override;
     QString relativeFilePath() const override;
@@ -102,3 +222,43 @@ private:
     RootNode &operator=(const RootNode&) = delete;
     QString path_;
 };
+
+
+///
+/// Item names of a tree by their case folded first character
+///
+/// Snapshot of the items at construction time, see DirNode::items. Keeps the
+/// directories and their name buffers alive. Immutable, hence thread-safe.
+///
+class NameIndex
+{
+public:
+    explicit NameIndex(const std::shared_ptr<const DirNode> &root);
+
+    ///
+    /// Matches the path components of items against tokens, in order and by case
+    /// insensitive prefix. Gaps are allowed. The last token matches item names, the others
+    /// match the names of the ancestors. matched is the number of tokens matched by the
+    /// components of the root path.
+    ///
+    /// Candidates are looked up by the last token, their ancestors are verified upwards.
+    /// Appends the best max_results matches, scored by the name coverage of the last token.
+    ///
+    void matchPath(const QStringList &tokens, qsizetype matched,
+                   std::vector<std::pair<std::shared_ptr<FileItem>, double>> &results,
+                   size_t max_results, const std::function<bool()> &cancelled) const;
+
+private:
+    struct Entry
+    {
+        uint32_t dir;  // index into dirs_
+        uint32_t name_offset;
+        uint16_t name_size;
+        uint16_t mime;
+    };
+
+    QStringView name(const Entry &) const;
+
+    std::vector<std::pair<std::shared_ptr<const DirNode>, QString>> dirs_;  // and their item names
+    std::unordered_map<char16_t, std::vector<Entry>> entries_;
+};
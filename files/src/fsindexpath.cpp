@@ -3,17 +3,43 @@
 #include "fileitems.h"
 #include "fsindexnodes.h"
 #include "fsindexpath.h"
+#include "scanthrottle.h"
+#include <QDataStream>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QJsonObject>
+#include <QThread>
+#include <QThreadPool>
 #include <albert/logging.h>
 using namespace std;
 
+static const int COALESCE_INTERVAL = 500;  // ms of silence before an informed update
+static const int MAX_COALESCE_LATENCY = 5000;  // ms
+static const size_t MAX_PENDING_DIRS = 10000;  // fall back to a full scan beyond
+
 FsIndexPath::FsIndexPath(const QString &path) : root_(RootNode::make(path))
 {
+#if defined(Q_OS_LINUX)
+    connect(&fs_watcher_, &InotifyWatcher::directoryChanged,
+            this, &FsIndexPath::onDirectoryChanged);
+    connect(&fs_watcher_, &InotifyWatcher::overflow,
+            this, &FsIndexPath::onWatchOverflow);
+#else
     connect(&fs_watcher_, &QFileSystemWatcher::directoryChanged,
+            this, &FsIndexPath::onDirectoryChanged);
+#endif
+    coalesce_timer_.setSingleShot(true);
+    coalesce_timer_.setInterval(COALESCE_INTERVAL);
+    connect(&coalesce_timer_, &QTimer::timeout,
             this, [this](){ emit updateRequired(this); });
     connect(&scan_interval_timer_, &QTimer::timeout,
-            this, [this](){ emit updateRequired(this); });
+            this, [this](){
+                {
+                    lock_guard lock(pending_mutex_);
+                    full_scan_required_ = true;
+                }
+                emit updateRequired(this);
+            });
 
     // Be tolerant but warn
     if (QFileInfo fi(root_->filePath()); !fi.exists())
@@ -22,42 +48,386 @@ FsIndexPath::FsIndexPath(const QString &path) : root_(RootNode::make(path))
         WARN << QString("Root path is not a directory: %1.").arg(fi.absolutePath());
 
     self = make_shared<StandardFile>(root_->filePath(), DirNode::dirMimeType());
+
+    name_index_ = make_shared<const NameIndex>(root_);
+    name_index_generation_ = generation_;
 }
 
 FsIndexPath::~FsIndexPath() = default;
 
-QJsonObject FsIndexPath::serialize() const
+void FsIndexPath::serialize(QIODevice &device) const
+{ root_->toBinary(device); }
+
+void FsIndexPath::deserialize(const uchar *data, qint64 size)
+{
+    auto root = RootNode::fromBinary(data, size);
+    unique_lock lock(tree_mutex_);
+    root_ = ::move(root);
+    ++generation_;
+}
+
+QJsonObject FsIndexPath::toJson() const
 { return root_->toJson(); }
 
-void FsIndexPath::deserialize(const QJsonObject &json_object)
-{ root_ = RootNode::fromJson(json_object); }
+void FsIndexPath::fromJson(const QJsonObject &json_object)
+{
+    auto root = RootNode::fromJson(json_object);
+    unique_lock lock(tree_mutex_);
+    root_ = ::move(root);
+    ++generation_;
+}
 
 QString FsIndexPath::path() const { return root_->filePath(); }
 
-void FsIndexPath::update(const bool &abort, std::function<void(const QString &)> status)
+QByteArray FsIndexPath::checkpoint() const
+{
+    QByteArray data;
+    lock_guard lock(checkpoint_.mutex);
+    if (!checkpoint_.completed.empty())
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << (quint64)checkpoint_.settings_hash << (quint32)checkpoint_.completed.size();
+        for (const auto &relative_path : checkpoint_.completed)
+            stream << relative_path;
+    }
+    return data;
+}
+
+void FsIndexPath::restoreCheckpoint(const QByteArray &data)
+{
+    quint64 settings_hash = 0;
+    quint32 size = 0;
+    set<QString> completed;
+
+    QDataStream stream(data);
+    stream >> settings_hash >> size;
+    for (quint32 i = 0; i < size && stream.status() == QDataStream::Ok; ++i)
+    {
+        QString relative_path;
+        stream >> relative_path;
+        completed.insert(relative_path);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        WARN << QString("Discarding malformed scan checkpoint of '%1'.").arg(path());
+    else
+    {
+        lock_guard lock(checkpoint_.mutex);
+        checkpoint_.settings_hash = (size_t)settings_hash;
+        checkpoint_.completed = ::move(completed);
+    }
+}
+
+uint64_t FsIndexPath::generation() const { return generation_; }
+
+qint64 FsIndexPath::estimatedCost() const { return estimated_cost_; }
+
+bool FsIndexPath::fullScanPending() const
+{
+    lock_guard lock(pending_mutex_);
+    return full_scan_required_ || force_update || pending_dirs_.empty();
+}
+
+bool FsIndexPath::listDirectories(const QString &dir_path, bool hidden, vector<QString> &names) const
+{
+    // Do not wait for running updates, callers fall back to listing the file system
+    shared_lock lock(tree_mutex_, try_to_lock);
+    if (!lock.owns_lock() || !coverage_.all || (hidden && !coverage_.hidden))
+        return false;
+
+    const auto root_path = root_->filePath();
+    if (!dir_path.startsWith(root_path)
+        || (dir_path.size() > root_path.size() && dir_path[root_path.size()] != u'/'
+            && !root_path.endsWith(u'/')))
+        return false;
+
+    // Nodes beyond max depth have no children
+    const auto relative_path = dir_path.mid(root_path.size());
+    if (coverage_.max_depth < QStringView(relative_path).split(u'/', Qt::SkipEmptyParts).size() + 1)
+        return false;
+
+    if (auto node = root_->node(relative_path); node)
+    {
+        vector<DirEntry> entries;
+        node->entries(entries);
+        for (auto &entry : entries)
+            if (entry.is_dir)
+                names.emplace_back(::move(entry.name));
+        return true;
+    }
+    return false;
+}
+
+void FsIndexPath::matchPath(const QStringList &tokens,
+                            vector<pair<shared_ptr<FileItem>, double>> &results,
+                            size_t max_results, const function<bool()> &cancelled) const
+{
+    const auto root_path = root_->filePath();
+    qsizetype matched = 0;
+    for (const auto &component : QStringView(root_path).split(u'/', Qt::SkipEmptyParts))
+        if (matched + 1 < tokens.size() && component.startsWith(tokens[matched], Qt::CaseInsensitive))
+            ++matched;
+
+    shared_ptr<const NameIndex> name_index;
+    {
+        lock_guard lock(name_index_mutex_);
+        name_index = name_index_;
+    }
+    name_index->matchPath(tokens, matched, results, max_results, cancelled);
+}
+
+void FsIndexPath::publishNameIndex()
+{
+    const uint64_t generation = generation_;
+    if (generation == name_index_generation_)
+        return;
+
+    shared_ptr<RootNode> root;
+    {
+        shared_lock lock(tree_mutex_);
+        root = root_;
+    }
+
+    auto name_index = make_shared<const NameIndex>(root);
+    name_index_generation_ = generation;
+
+    lock_guard lock(name_index_mutex_);
+    name_index_.swap(name_index);  // the former one is released unlocked
+}
+
+vector<QString> FsIndexPath::findContent(const QString &text, size_t max_results,
+                                         const function<bool()> &cancelled) const
+{
+    if (!content_indexing)
+        return {};
+    return content_index_.find(root_->filePath(), text, max_results, cancelled);
+}
+
+vector<QString> FsIndexPath::contentCandidates(const QString &text) const
+{
+    if (!content_indexing)
+        return {};
+    return content_index_.candidates(root_->filePath(), text);
+}
+
+uint64_t FsIndexPath::contentRevision() const { return content_index_.revision(); }
+
+void FsIndexPath::serializeContent(QIODevice &device) const
+{
+    if (content_indexing)
+    {
+        QDataStream stream(&device);
+        content_index_.serialize(stream);
+    }
+}
+
+void FsIndexPath::deserializeContent(const uchar *data, qint64 size)
+{
+    if (size == 0)
+        return;
+    const auto bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), size);
+    QDataStream stream(bytes);
+    content_index_.deserialize(stream);
+}
+
+void FsIndexPath::update(const atomic_bool &abort, std::function<void(const QString &)> status)
 {
     IndexSettings s;
 
     s.root_path = this->path();
 
+    vector<NameFilter> filters;
     for (const auto &pattern : name_filters)
-        s.name_filters.emplace_back(pattern);
+        filters.emplace_back(pattern);
+    s.name_filters = NameFilterMatcher(filters);
     for (const auto &pattern : mime_filters)
         s.mime_filters.emplace_back(QRegularExpression::fromWildcard(pattern,
                                                                      Qt::CaseSensitive,
                                                                      QRegularExpression::UnanchoredWildcardConversion));
+    // Unanchored patterns matching "/" match all mime type names, e.g. "*" or "*/*"
+    s.mime_filters_match_all = any_of(s.mime_filters.begin(), s.mime_filters.end(),
+                                      [](const auto &re){ return re.match(QStringLiteral("/")).hasMatch(); });
     s.index_hidden_files = index_hidden_files;
     s.follow_symlinks = follow_symlinks;
     s.max_depth = max_depth;
-    s.forced = force_update;
-    std::set<QString> indexed_dirs;
+    s.forced = force_update.exchange(false);  // settings may change while scanning
+    s.mime_resolution = mime_resolution;
+    IndexState state{abort, status};
+
+    // Unfollowed symlinks to directories are items, if directories are
+    const auto dir_mime = QStringLiteral("inode/directory");
+    const bool dir_items = any_of(s.mime_filters.begin(), s.mime_filters.end(),
+                                  [&](const auto &re){ return re.match(dir_mime).hasMatch(); });
+    const Coverage coverage{name_filters.isEmpty() && (follow_symlinks || dir_items),
+                            index_hidden_files, max_depth};
+
+    QStringList new_dirs;
+    if (watch_fs)
+        state.new_dirs = &new_dirs;
+
+    // Update the directories reported by the watcher only, if possible
+    set<QString> dirs;
+    bool full_scan;
+    {
+        lock_guard lock(pending_mutex_);
+        full_scan = full_scan_required_ || s.forced || pending_dirs_.empty();
+        if (full_scan)
+            pending_dirs_.clear();
+        else
+            dirs.swap(pending_dirs_);
+        full_scan_required_ = false;
+    }
+
+    bool resumed = false;
+    if (full_scan)
+    {
+        // Resume an interrupted scan, unless the settings changed meanwhile
+        const auto settings_hash = qHashMulti(0, name_filters, mime_filters, index_hidden_files,
+                                              follow_symlinks, max_depth, (int)mime_resolution);
+        lock_guard lock(checkpoint_.mutex);
+        if (checkpoint_.settings_hash != settings_hash)
+        {
+            checkpoint_.settings_hash = settings_hash;
+            checkpoint_.completed.clear();
+        }
+        else if (!checkpoint_.completed.empty())
+        {
+            INFO << QString("Resuming scan of '%1', skipping %2 completed subtrees.")
+                        .arg(path()).arg(checkpoint_.completed.size());
+            resumed = true;
+        }
+        state.checkpoint = &checkpoint_;
+    }
+
+    if (content_indexing)
+    {
+        content_index_.beginScan();
+        state.content_index = &content_index_;
+    }
+    else if (content_index_.documentCount())
+        content_index_.clear();  // disabled meanwhile
+
+    // Throttle full scans only, informed updates are cheap and should be timely
+    unique_ptr<ScanThrottle> throttle;
+    if (full_scan && max_scan_rate)
+    {
+        throttle = make_unique<ScanThrottle>(max_scan_rate, status);
+        state.throttle = throttle.get();
+    }
+
+    // Unforced full scans stat all directories upfront and merge the modified ones only.
+    // Not if the contents of unmodified directories are needed and not if throttled.
+    const bool sweep = full_scan && !s.forced && !resumed && !state.content_index && !throttle;
+    if (sweep)
+        state.checkpoint = nullptr;  // fast, nothing to resume
+
+    // Deserialized trees are indexed before the first scan
+    publishNameIndex();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto scan = [&]
+    {
+        QThreadPool pool;
+        if (scan_threads > 1)
+        {
+            pool.setMaxThreadCount((int)scan_threads - 1);  // The calling thread scans as well
+            state.pool = &pool;
+        }
+
+        unique_lock tree_lock(tree_mutex_);  // see listDirectories()
+
+        // Partial scans leave subtrees built with the previous settings
+        coverage_ = {coverage_.all && coverage.all,
+                     coverage_.hidden && coverage.hidden,
+                     min(coverage_.max_depth, coverage.max_depth)};
+        if (sweep)
+        {
+            s.scan_mode = false;
+            for (const auto &modified
+                 : root_->sweep(state, max((int)scan_threads, QThread::idealThreadCount())))
+            {
+                const auto relative_path = modified->relativeFilePath();
+                if (auto node = root_->node(relative_path); node == modified)  // else removed meanwhile
+                {
+                    node->update(node, s, state, relative_path.count('/') + 1);
+                    pool.waitForDone();  // next lookup may traverse new subtrees
+                }
+            }
+        }
+        else if (full_scan)
+            root_->update(root_, s, state, 1);
+        else
+        {
+            s.scan_mode = false;
+            for (const auto &dir : dirs)  // sorted, hence parents before children
+            {
+                const auto relative_path = dir.mid(s.root_path.size());
+                if (auto node = root_->node(relative_path); node)  // else removed meanwhile
+                {
+                    node->markDirty();  // mdates have a resolution of seconds
+                    node->update(node, s, state, relative_path.count('/') + 1);
+                    pool.waitForDone();  // next lookup may traverse new subtrees
+                }
+            }
+        }
+        pool.waitForDone();
+    };
+
+    if (throttle)
+        runInBackground(scan);
+    else
+        scan();
+
+    if (state.changed)  // Partial updates count as well
+        ++generation_;
+
+    publishNameIndex();
+
+    if (full_scan && !abort)
+    {
+        {
+            unique_lock lock(tree_mutex_);
+            coverage_ = coverage;
+        }
+        lock_guard lock(checkpoint_.mutex);
+        checkpoint_.completed.clear();
+    }
+
+    // Completed full scans visited all directories, documents elsewhere have been removed
+    if (state.content_index)
+        content_index_.finishScan(full_scan && !abort && !resumed);
+
+    if (abort)  // Retry what has been aborted
+    {
+        if (s.forced)
+            force_update = true;
+        lock_guard lock(pending_mutex_);
+        if (full_scan)
+            full_scan_required_ = true;
+        else
+            pending_dirs_.merge(dirs);
+    }
+
+    if (!new_dirs.isEmpty())
+        QMetaObject::invokeMethod(this, [this, new_dirs]{
+            if (watch_fs)
+                fs_watcher_.addPaths(new_dirs);
+        }, Qt::QueuedConnection);
 
-    root_->update(root_, abort, status, s, indexed_dirs, 1);
+    const auto dir_count = state.indexed_dirs.size();
+    const auto elapsed = max<qint64>(timer.elapsed(), 1);
+    if (const auto cost = estimated_cost_.load(); !abort)  // learned for the scheduler
+        estimated_cost_ = cost ? (3 * cost + elapsed) / 4 : elapsed;
 
-    status(tr("Indexed %n directories in %1.", nullptr, indexed_dirs.size()).arg(path()));
+    const auto rate = dir_count * 1000 / elapsed;
+    INFO << QString("%1 %2 directories of '%3' in %4 ms using %5 threads (%6 dirs/s%7).")
+                .arg(full_scan ? "Scanned" : "Updated")
+                .arg(dir_count).arg(path()).arg(elapsed).arg(scan_threads).arg(rate)
+                .arg(throttle ? QString(", throttled to %1").arg(max_scan_rate) : QString());
 
-    if (s.forced && !abort) // In case of successful forced run clear force flag
-        force_update = false;
+    status(tr("Indexed %n directories in %1.", nullptr, dir_count).arg(path()));
 }
 
 void FsIndexPath::items(vector<shared_ptr<FileItem>> &items) const
@@ -80,6 +450,16 @@ bool FsIndexPath::watchFileSystem() const { return watch_fs; }
 
 uint FsIndexPath::scanInterval() const { return (uint)(scan_interval_timer_.interval()/60000); }
 
+uint FsIndexPath::scanThreads() const { return scan_threads; }
+
+MimeResolution FsIndexPath::mimeResolution() const { return mime_resolution; }
+
+int FsIndexPath::priority() const { return priority_; }
+
+uint FsIndexPath::maxScanRate() const { return max_scan_rate; }
+
+bool FsIndexPath::contentIndexing() const { return content_indexing; }
+
 void FsIndexPath::setNameFilters(const QStringList &val)
 {
     name_filters = val;
@@ -140,3 +520,70 @@ void FsIndexPath::setScanInterval(uint minutes)
         scan_interval_timer_.stop();
 }
 
+void FsIndexPath::setScanThreads(uint val) { scan_threads = max(val, 1u); }
+
+void FsIndexPath::setMimeResolution(MimeResolution val)
+{
+    if (mime_resolution == val)
+        return;
+    mime_resolution = val;
+    force_update = true;
+    emit updateRequired(this);
+}
+
+void FsIndexPath::setPriority(int val) { priority_ = val; }
+
+void FsIndexPath::setMaxScanRate(uint val) { max_scan_rate = val; }
+
+void FsIndexPath::setContentIndexing(bool val)
+{
+    if (content_indexing == val)
+        return;
+    content_indexing = val;
+    if (val)  // Unchanged directories have to be listed
+    {
+        force_update = true;
+        emit updateRequired(this);
+    }
+}
+
+void FsIndexPath::onDirectoryChanged(const QString &path)
+{
+    {
+        lock_guard lock(pending_mutex_);
+        if (full_scan_required_)
+            return coalesceUpdates();  // Covered by the pending full scan
+        if (pending_dirs_.size() < MAX_PENDING_DIRS)
+            pending_dirs_.insert(path);
+        else
+        {
+            full_scan_required_ = true;
+            pending_dirs_.clear();
+        }
+    }
+    coalesceUpdates();
+}
+
+void FsIndexPath::onWatchOverflow()
+{
+    WARN << "File system events have been lost. Scanning" << path();
+    {
+        lock_guard lock(pending_mutex_);
+        full_scan_required_ = true;
+        pending_dirs_.clear();
+    }
+    coalesceUpdates();
+}
+
+void FsIndexPath::coalesceUpdates()
+{
+    // Bursts (e.g. a checkout touching thousands of files) result in a single update.
+    // Debounce, but do not defer the update indefinitely under continuous load.
+    if (!coalesce_timer_.isActive())
+    {
+        coalesce_latency_.start();
+        coalesce_timer_.start();
+    }
+    else if (coalesce_latency_.elapsed() < MAX_COALESCE_LATENCY)
+        coalesce_timer_.start();
+}
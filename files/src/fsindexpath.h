@@ -1,13 +1,25 @@
 // Copyright (c) 2022-2023 Manuel Schneider
 
 #pragma once
-#include <QFileSystemWatcher>
+#include "contentindex.h"
+#include "fsindexnodes.h"
+#include <QElapsedTimer>
 #include <QStringList>
 #include <QTimer>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <vector>
+#if defined(Q_OS_LINUX)
+#include "inotifywatcher.h"
+#else
+#include <QFileSystemWatcher>
+#endif
 class FileItem;
+class QIODevice;
 class QJsonObject;
 class RootNode;
 
@@ -19,11 +31,58 @@ public:
     FsIndexPath(const QString &path);
     ~FsIndexPath();
 
-    QJsonObject serialize() const;
-    void deserialize(const QJsonObject &json);
+    void serialize(QIODevice &device) const;  // thread-safe, also while updating
+    void deserialize(const uchar *data, qint64 size);  // throws
+    QJsonObject toJson() const;
+    void fromJson(const QJsonObject &json);
 
     QString path() const;
-    void update(const bool &abort, std::function<void(const QString&)> status);
+
+    /// Progress of an interrupted full scan, resumed by the next one. Thread-safe.
+    /// Empty if there is none.
+    QByteArray checkpoint() const;
+    void restoreCheckpoint(const QByteArray &);
+
+    /// Changes whenever the indexed tree changed
+    uint64_t generation() const;
+
+    /// Duration of recent updates in ms, exponentially weighted. 0 if unknown. Thread-safe.
+    qint64 estimatedCost() const;
+
+    /// Whether the next update scans the entire tree, as opposed to the directories
+    /// reported by the watcher only. Thread-safe.
+    bool fullScanPending() const;
+
+    /// Lists the subdirectories of the directory at dir_path, including hidden ones if
+    /// hidden is set. Thread-safe.
+    /// @returns false if the directory is not indexed, the settings exclude some of its
+    /// subdirectories (e.g. name filters, max depth) or the index is being updated
+    bool listDirectories(const QString &dir_path, bool hidden, std::vector<QString> &names) const;
+
+    /// Finds indexed files by the components of their paths, including the components of
+    /// the root path. Needs at least one token. Thread-safe. Reads the name index published
+    /// by the last update(), never blocks on building it.
+    /// @see NameIndex::matchPath
+    void matchPath(const QStringList &tokens,
+                   std::vector<std::pair<std::shared_ptr<FileItem>, double>> &results,
+                   size_t max_results, const std::function<bool()> &cancelled) const;
+
+    /// Finds indexed text files containing text. Thread-safe.
+    /// @see ContentIndex::find
+    std::vector<QString> findContent(const QString &text, size_t max_results,
+                                     const std::function<bool()> &cancelled) const;
+
+    /// Unverified results of findContent. Thread-safe.
+    /// @see ContentIndex::candidates
+    std::vector<QString> contentCandidates(const QString &text) const;
+
+    /// Changes whenever the content index changed
+    uint64_t contentRevision() const;
+
+    void serializeContent(QIODevice &device) const;  // thread-safe, also while updating
+    void deserializeContent(const uchar *data, qint64 size);  // throws
+
+    void update(const std::atomic_bool &abort, std::function<void(const QString&)> status);
     void items(std::vector<std::shared_ptr<FileItem>>&) const;
 
     const QStringList &nameFilters() const;
@@ -33,6 +92,11 @@ public:
     uint8_t maxDepth() const;
     bool watchFileSystem() const;
     uint scanInterval() const;
+    uint scanThreads() const;
+    MimeResolution mimeResolution() const;
+    int priority() const;
+    uint maxScanRate() const;  // directories per second, 0 if not throttled
+    bool contentIndexing() const;
 
     void setNameFilters(const QStringList&);
     void setMimeFilters(const QStringList&);
@@ -41,9 +105,17 @@ public:
     void setMaxDepth(uint8_t);
     void setWatchFilesystem(bool);
     void setScanInterval(uint minutes);
+    void setScanThreads(uint);
+    void setMimeResolution(MimeResolution);
+    void setPriority(int);
+    void setMaxScanRate(uint);
+    void setContentIndexing(bool);
 
 private:
     void init();
+    void onDirectoryChanged(const QString &path);
+    void onWatchOverflow();
+    void coalesceUpdates();
 
     QStringList name_filters;
     QStringList mime_filters;
@@ -51,10 +123,48 @@ private:
     bool index_hidden_files = false;
     bool follow_symlinks = false;
     bool watch_fs = false;
-    bool force_update = false;
+    std::atomic_bool force_update = false;
+    uint scan_threads = 1;
+    int priority_ = 0;
+    uint max_scan_rate = 0;
+    std::atomic_bool content_indexing = false;
+    ContentIndex content_index_;
+    std::atomic<uint64_t> generation_ = 1;
+    std::atomic<qint64> estimated_cost_ = 0;
+    mutable Checkpoint checkpoint_;
+    mutable std::shared_mutex tree_mutex_;  // guards root_ against concurrent readers
+
+    // Rebuilt by update() whenever the generation changed, published for matchPath().
+    void publishNameIndex();
+    mutable std::mutex name_index_mutex_;  // guards the pointer only
+    std::shared_ptr<const NameIndex> name_index_;
+    uint64_t name_index_generation_;  // of name_index_, accessed by update() only
+
+    // Subdirectories contained in the tree, depends on the settings of the scans that built it.
+    // Guarded by tree_mutex_.
+    struct Coverage
+    {
+        bool all = false;  // no name filters, symlinks followed or listed
+        bool hidden = false;
+        uint8_t max_depth = 0;
+    };
+    Coverage coverage_;
+    MimeResolution mime_resolution = MimeResolution::Content;
     QTimer scan_interval_timer_;
 
+#if defined(Q_OS_LINUX)
+    InotifyWatcher fs_watcher_;
+#else
     QFileSystemWatcher fs_watcher_;
+#endif
+    QTimer coalesce_timer_;
+    QElapsedTimer coalesce_latency_;
+
+    // Informed updates. Guarded by pending_mutex_, since the indexer runs threaded.
+    mutable std::mutex pending_mutex_;
+    std::set<QString> pending_dirs_;
+    bool full_scan_required_ = true;
+
     std::shared_ptr<RootNode> root_;
     std::shared_ptr<FileItem> self;
 
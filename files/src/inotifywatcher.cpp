@@ -0,0 +1,205 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "inotifywatcher.h"
+#include <QFile>
+#include <QSocketNotifier>
+#include <albert/logging.h>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <sys/inotify.h>
+#include <unistd.h>
+using namespace std;
+
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                   | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+InotifyWatcher::InotifyWatcher() : fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+    if (fd_ < 0)
+        WARN << "Failed initializing inotify:" << strerror(errno);
+    else
+    {
+        notifier_ = new QSocketNotifier(fd_, QSocketNotifier::Read, this);
+        connect(notifier_, &QSocketNotifier::activated, this, &InotifyWatcher::readEvents);
+    }
+}
+
+InotifyWatcher::~InotifyWatcher()
+{
+    if (fd_ >= 0)
+    {
+        delete notifier_;
+        close(fd_);  // Removes all watches
+    }
+}
+
+QStringList InotifyWatcher::directories() const
+{
+    QStringList l;
+    for (const auto &[path, _] : descriptors_)
+        l << path;
+    return l;
+}
+
+QStringList InotifyWatcher::addPaths(const QStringList &paths)
+{
+    QStringList failed;
+    bool limit_warned = false;
+
+    for (const auto &path : paths)
+    {
+        if (descriptors_.contains(path))
+            continue;
+
+        if (fd_ < 0)
+            failed << path;
+
+        else if (auto wd = inotify_add_watch(fd_, QFile::encodeName(path).constData(), WATCH_MASK);
+                 wd < 0)
+        {
+            if (errno == ENOSPC && !limit_warned)
+            {
+                WARN << "Inotify watch limit reached. See /proc/sys/fs/inotify/max_user_watches.";
+                limit_warned = true;
+            }
+            failed << path;
+        }
+
+        else
+        {
+            paths_[wd] = path;
+            descriptors_[path] = wd;
+        }
+    }
+
+    return failed;
+}
+
+QStringList InotifyWatcher::removePaths(const QStringList &paths)
+{
+    QStringList failed;
+
+    for (const auto &path : paths)
+    {
+        if (auto it = descriptors_.find(path); it == descriptors_.end())
+            failed << path;
+        else
+        {
+            inotify_rm_watch(fd_, it->second);
+            paths_.erase(it->second);
+            descriptors_.erase(it);
+        }
+    }
+
+    return failed;
+}
+
+vector<pair<QString, int>> InotifyWatcher::takeSubtree(const QString &path)
+{
+    vector<pair<QString, int>> watches;
+    const auto take = [&](map<QString, int>::iterator it)
+    {
+        watches.emplace_back(it->first, it->second);
+        paths_.erase(it->second);
+        return descriptors_.erase(it);
+    };
+
+    if (auto it = descriptors_.find(path); it != descriptors_.end())
+        take(it);
+
+    // Not contiguous with path, e.g. "a-b" sorts between "a" and "a/b"
+    const auto prefix = path + u'/';
+    for (auto it = descriptors_.lower_bound(prefix);
+         it != descriptors_.end() && it->first.startsWith(prefix);)
+        it = take(it);
+
+    return watches;
+}
+
+void InotifyWatcher::moveSubtree(const QString &from, const QString &to)
+{
+    // The watches stay valid, they refer to the inodes
+    for (auto &[path, wd] : takeSubtree(from))
+    {
+        auto moved_path = to + path.mid(from.size());
+        paths_[wd] = moved_path;
+        descriptors_[::move(moved_path)] = wd;
+    }
+}
+
+void InotifyWatcher::removeSubtree(const QString &path)
+{
+    for (const auto &[_, wd] : takeSubtree(path))
+        inotify_rm_watch(fd_, wd);  // IN_IGNORED of unknown watches is skipped
+}
+
+void InotifyWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    set<QString> changed;  // Report every directory once per read
+    bool overflowed = false;
+    map<uint32_t, QString> moved_from;  // cookie > path of a directory moved away
+    set<int> moved_self;  // watches of moved directories
+    set<int> moved_within;  // watches of directories moved between watched directories
+
+    for (ssize_t size; (size = read(fd_, buffer, sizeof(buffer))) > 0;)
+        for (char *p = buffer; p < buffer + size;)
+        {
+            const auto *event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+                overflowed = true;
+
+            else if (auto it = paths_.find(event->wd); it != paths_.end())
+            {
+                if (event->mask & IN_IGNORED)  // Watch removed, e.g. directory deleted
+                {
+                    // The path may be watched by another descriptor meanwhile, e.g. moved there
+                    if (auto d = descriptors_.find(it->second);
+                        d != descriptors_.end() && d->second == event->wd)
+                        descriptors_.erase(d);
+                    paths_.erase(it);
+                    continue;
+                }
+
+                changed.insert(it->second);
+
+                if (event->mask & IN_MOVE_SELF)  // Follows the IN_MOVED_FROM/TO pair, if any
+                    moved_self.insert(event->wd);
+
+                else if ((event->mask & IN_ISDIR) && event->len > 0)
+                {
+                    auto path = QString("%1/%2").arg(it->second, QFile::decodeName(event->name));
+                    if (event->mask & IN_MOVED_FROM)
+                        moved_from[event->cookie] = ::move(path);
+                    else if (event->mask & IN_MOVED_TO)
+                        if (auto m = moved_from.find(event->cookie); m != moved_from.end())
+                        {
+                            if (auto d = descriptors_.find(m->second); d != descriptors_.end())
+                                moved_within.insert(d->second);
+                            moveSubtree(m->second, path);
+                            moved_from.erase(m);
+                        }
+                }
+            }
+        }
+
+    // Directories moved out of the watched directories, including moved roots
+    for (const auto &[cookie, path] : moved_from)
+        removeSubtree(path);
+    for (auto wd : moved_self)
+        if (!moved_within.contains(wd))
+            if (auto it = paths_.find(wd); it != paths_.end())
+            {
+                changed.insert(it->second);  // vanished for the watcher
+                removeSubtree(QString(it->second));
+            }
+
+    if (overflowed)
+        emit overflow();
+    else
+        for (const auto &path : changed)
+            emit directoryChanged(path);
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QObject>
+#include <QStringList>
+#include <map>
+#include <utility>
+#include <vector>
+class QSocketNotifier;
+
+///
+/// Minimal inotify based directory watcher
+///
+/// Drop in for the parts of QFileSystemWatcher used by FsIndexPath. Unlike
+/// QFileSystemWatcher it reports kernel queue overflows (IN_Q_OVERFLOW),
+/// i.e. lost events, which require a full rescan of the watched tree.
+///
+/// Watches follow their directories. Directories moved within the watched
+/// directories keep their watches, the watched paths of their subtrees are
+/// renamed. Directories moved elsewhere are no longer watched.
+///
+class InotifyWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    InotifyWatcher();
+    ~InotifyWatcher();
+
+    /// @returns The watched directories
+    QStringList directories() const;
+
+    /// Watch directories. Already watched directories are skipped.
+    /// @returns The paths that could not be watched
+    QStringList addPaths(const QStringList &paths);
+
+    /// Stop watching directories
+    /// @returns The paths that could not be removed
+    QStringList removePaths(const QStringList &paths);
+
+signals:
+
+    /// Entries of the directory at path have been created, deleted or moved
+    void directoryChanged(const QString &path);
+
+    /// The event queue overflowed, events have been lost
+    void overflow();
+
+private:
+
+    void readEvents();
+
+    // Unregisters the watches of the directory at path and its subdirectories
+    std::vector<std::pair<QString, int>> takeSubtree(const QString &path);
+    void moveSubtree(const QString &from, const QString &to);
+    void removeSubtree(const QString &path);
+
+    const int fd_;
+    QSocketNotifier *notifier_ = nullptr;
+    std::map<int, QString> paths_;  // watch descriptor > path
+    std::map<QString, int> descriptors_;  // path > watch descriptor
+
+};
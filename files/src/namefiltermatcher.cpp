@@ -0,0 +1,152 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "fsindexnodes.h"
+#include "namefiltermatcher.h"
+#include <optional>
+using namespace std;
+
+namespace {
+
+struct ParsedLiteral
+{
+    QString text;
+    bool begin = false;
+    bool end = false;
+};
+
+// The fixed string a pattern matches, if it does not need the regex engine
+optional<ParsedLiteral> parseLiteral(const QString &pattern)
+{
+    static const QString metacharacters = QStringLiteral(".^$*+?()[]{}|");
+
+    ParsedLiteral literal;
+    QStringView p(pattern);
+    if (p.startsWith(u'^'))
+    {
+        literal.begin = true;
+        p = p.mid(1);
+    }
+
+    for (qsizetype i = 0; i < p.size(); ++i)
+    {
+        const auto c = p[i];
+        if (c == u'\\')
+        {
+            // Escaped punctuation is literal, anything else is a class or reference
+            if (i + 1 == p.size() || p[i + 1].isLetterOrNumber())
+                return nullopt;
+            literal.text.append(p[++i]);
+        }
+        else if (c == u'$' && i + 1 == p.size())
+            literal.end = true;
+        else if (metacharacters.contains(c))
+            return nullopt;
+        else
+            literal.text.append(c);
+    }
+
+    return literal;
+}
+
+// Capture group numbers change when combined. Keep patterns referencing them separate.
+bool isCombinable(const QRegularExpression &regex)
+{
+    static const QRegularExpression backreference(R"(\\[1-9gk]|\(\?P=)");
+    return regex.patternOptions() == QRegularExpression::NoPatternOption
+           && !backreference.match(regex.pattern()).hasMatch();
+}
+
+inline bool hasMatch(const QRegularExpression &regex, QStringView subject)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+    return regex.matchView(subject).hasMatch();
+#else
+    return regex.match(subject).hasMatch();
+#endif
+}
+
+}
+
+NameFilterMatcher::NameFilterMatcher(const vector<NameFilter> &filters)
+{
+    QStringList combined;
+    auto flush = [&]
+    {
+        if (combined.isEmpty())
+            return;
+
+        auto &regexes = sets_.back().regexes;
+        if (QRegularExpression regex(QString("(?:%1)").arg(combined.join(")|(?:"))); regex.isValid())
+            regexes.emplace_back(::move(regex));
+        else  // e.g. verbs that have to be at the start of a pattern
+            for (const auto &pattern : combined)
+                regexes.emplace_back(pattern);
+
+        for (auto &regex : regexes)
+            regex.optimize();
+        combined.clear();
+    };
+
+    for (auto it = filters.rbegin(); it != filters.rend(); ++it)
+    {
+        if (!it->regex.isValid())
+            continue;  // Never matched before either
+
+        if (sets_.empty() || sets_.back().type != it->type)
+        {
+            if (!sets_.empty())
+                flush();
+            sets_.push_back({it->type, {}, {}});
+        }
+
+        auto &set = sets_.back();
+        if (it->regex.patternOptions() != QRegularExpression::NoPatternOption)
+            set.regexes.emplace_back(it->regex);
+        else if (auto literal = parseLiteral(it->regex.pattern()); literal)
+            set.literals.push_back({literal->text,
+                                    (literal->begin ? Literal::Begin : Literal::None)
+                                        | (literal->end ? Literal::End : Literal::None)});
+        else if (isCombinable(it->regex))
+            combined << it->regex.pattern();
+        else
+            set.regexes.emplace_back(it->regex);
+    }
+    if (!sets_.empty())
+        flush();
+}
+
+bool NameFilterMatcher::Set::matches(QStringView relative_path) const
+{
+    for (const auto &literal : literals)
+        switch (literal.anchors) {
+        case Literal::None:
+            if (relative_path.contains(literal.text))
+                return true;
+            break;
+        case Literal::Begin:
+            if (relative_path.startsWith(literal.text))
+                return true;
+            break;
+        case Literal::End:
+            if (relative_path.endsWith(literal.text))
+                return true;
+            break;
+        default:
+            if (relative_path == literal.text)
+                return true;
+        }
+
+    for (const auto &regex : regexes)
+        if (hasMatch(regex, relative_path))
+            return true;
+
+    return false;
+}
+
+bool NameFilterMatcher::excludes(QStringView relative_path) const
+{
+    for (const auto &set : sets_)
+        if (set.matches(relative_path))
+            return set.type == PatternType::Exclude;
+    return false;
+}
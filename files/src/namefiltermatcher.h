@@ -0,0 +1,49 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QRegularExpression>
+#include <QString>
+#include <vector>
+struct NameFilter;
+enum class PatternType;
+
+///
+/// Name filters compiled for matching many paths
+///
+/// The result is the type of the last matching filter, which is equivalent
+/// to toggling through the filters in order. Hence consecutive filters of the
+/// same type are evaluated as a set. Patterns that are plain strings, possibly
+/// anchored by ^ and $, are matched without the regex engine. The remaining
+/// patterns of a set are combined into a single regular expression.
+///
+class NameFilterMatcher
+{
+public:
+
+    NameFilterMatcher() = default;
+    explicit NameFilterMatcher(const std::vector<NameFilter> &filters);
+
+    /// @returns true if the path relative to the index root is excluded
+    bool excludes(QStringView relative_path) const;
+
+private:
+
+    struct Literal
+    {
+        enum Anchor { None = 0, Begin = 1, End = 2 };
+        QString text;
+        int anchors;
+    };
+
+    // Consecutive filters of the same type
+    struct Set
+    {
+        PatternType type;
+        std::vector<Literal> literals;
+        std::vector<QRegularExpression> regexes;
+        bool matches(QStringView relative_path) const;
+    };
+
+    std::vector<Set> sets_;  // last set first
+
+};
@@ -3,14 +3,22 @@
 #include "configwidget.h"
 #include "fileitems.h"
 #include "plugin.h"
+#include "scanthrottle.h"
 #include <QDir>
+#include <QElapsedTimer>
+#include <QGuiApplication>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QRegularExpression>
+#include <QSaveFile>
 #include <QSettings>
+#include <QtConcurrentRun>
 #include <albert/albert.h>
 #include <albert/extensionregistry.h>
 #include <albert/logging.h>
 #include <albert/standarditem.h>
+#include <cstddef>
+#include <cstring>
 ALBERT_LOGGING_CATEGORY("files")
 using namespace albert;
 using namespace std;
@@ -34,31 +42,205 @@ const char* CFG_MAX_DEPTH = "maxDepth";
 const uint8_t DEF_MAX_DEPTH = 255;
 const char* CFG_SCAN_INTERVAL = "scanInterval";
 const uint DEF_SCAN_INTERVAL = 5;
-const char* INDEX_FILE_NAME = "file_index.json";
+const char* CFG_SCAN_THREADS = "scanThreads";
+const uint DEF_SCAN_THREADS = 1;
+const char* CFG_MIME_RESOLUTION = "mimeResolution";
+const MimeResolution DEF_MIME_RESOLUTION = MimeResolution::Content;
+const char* CFG_PRIORITY = "priority";
+const int DEF_PRIORITY = 0;
+const char* CFG_MAX_SCAN_RATE = "maxScanRate";
+const uint DEF_MAX_SCAN_RATE = 0;
+const char* CFG_CONTENT_INDEX = "contentIndex";
+const bool DEF_CONTENT_INDEX = false;
+const char* CFG_MAX_CONCURRENT_SCANS = "maxConcurrentScans";
+const char* INDEX_FILE_NAME = "file_index.bin";
+const char* LEGACY_INDEX_FILE_NAME = "file_index.json";
+const char INDEX_FILE_MAGIC[8] = {'A', 'L', 'B', 'F', 'I', 'L', 'E', 'S'};
+const uint32_t INDEX_FILE_VERSION = 3;
+const int PERSIST_INTERVAL = 2 * 60 * 1000;  // ms
+const size_t MAX_PATH_MATCHES = 100;
 applications::Plugin *apps;
 
+namespace {
+
+// Index file layout: a header followed by one record per index path. Each record consists of a
+// record header, the UTF-16 path, the scan checkpoint (see FsIndexPath::checkpoint, since
+// version 2), the binary index (see RootNode::toBinary) and the content index (see
+// ContentIndex::serialize, since version 3), each padded to 8 bytes, such that the binary
+// indices can be read in place from a memory mapped file.
+//
+// Records of versions before 3 lack the content_size field.
+
+struct IndexFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_count;
+};
+
+struct IndexFileRecord
+{
+    uint32_t path_size;  // UTF-16 code units
+    uint32_t checkpoint_size;  // bytes, reserved in version 1
+    uint64_t data_size;
+    uint64_t content_size;  // bytes, since version 3
+};
+
+static qint64 recordSize(uint32_t version)
+{ return version < 3 ? offsetof(IndexFileRecord, content_size) : sizeof(IndexFileRecord); }
+
+struct IndexRecord
+{
+    const uchar *data;
+    qint64 size;
+    QByteArray checkpoint;
+    const uchar *content;
+    qint64 content_size;
+};
+
+static qint64 padded(qint64 size) { return (size + 7) & ~qint64(7); }
+
+static void writePadding(QIODevice &device, qint64 size)
+{
+    static const char zeros[8]{};
+    device.write(zeros, padded(size) - size);
+}
+
+static map<QString, IndexRecord> readIndexFile(const uchar *data, qint64 size)
+{
+    map<QString, IndexRecord> records;
+
+    if (size < (qint64)sizeof(IndexFileHeader))
+        return records;
+
+    const auto *header = reinterpret_cast<const IndexFileHeader*>(data);
+    if (memcmp(header->magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC)) != 0
+        || header->version < 1 || header->version > INDEX_FILE_VERSION)
+    {
+        WARN << "Ignoring index file of unknown format or version.";
+        return records;
+    }
+
+    qint64 pos = sizeof(IndexFileHeader);
+    for (uint32_t i = 0; i < header->record_count; ++i)
+    {
+        if (pos + recordSize(header->version) > size)
+            break;
+        IndexFileRecord record{};
+        memcpy(&record, data + pos, recordSize(header->version));
+        pos += recordSize(header->version);
+
+        const auto path_bytes = padded(record.path_size * (qint64)sizeof(char16_t));
+        const auto checkpoint_size = header->version < 2 ? 0 : (qint64)record.checkpoint_size;
+        const auto content_size = (qint64)record.content_size;
+        if (pos + path_bytes + padded(checkpoint_size) + padded((qint64)record.data_size)
+                + content_size > size)
+            break;
+        QString path(reinterpret_cast<const QChar*>(data + pos), record.path_size);
+        pos += path_bytes;
+
+        QByteArray checkpoint(reinterpret_cast<const char*>(data + pos), checkpoint_size);
+        pos += padded(checkpoint_size);
+
+        const auto *index_data = data + pos;
+        pos += padded(record.data_size);
+
+        records.emplace(path, IndexRecord{index_data, (qint64)record.data_size, ::move(checkpoint),
+                                          data + pos, content_size});
+        pos += padded(content_size);
+    }
+
+    return records;
+}
+
+static void writeIndexFile(QIODevice &device, const FsIndex &index)
+{
+    IndexFileHeader header{};
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+    header.version = INDEX_FILE_VERSION;
+    device.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    index.forEachPath([&](const FsIndexPath &fsp)
+    {
+        const auto path = fsp.path();
+        const auto checkpoint = fsp.checkpoint();
+
+        // Data size is not known in advance. Write the record header afterwards.
+        const auto record_pos = device.pos();
+        IndexFileRecord record{(uint32_t)path.size(), (uint32_t)checkpoint.size(), 0, 0};
+        device.write(reinterpret_cast<const char*>(&record), sizeof(record));
+
+        const auto path_bytes = path.size() * (qint64)sizeof(char16_t);
+        device.write(reinterpret_cast<const char*>(path.utf16()), path_bytes);
+        writePadding(device, path_bytes);
+
+        device.write(checkpoint);
+        writePadding(device, checkpoint.size());
+
+        const auto data_pos = device.pos();
+        fsp.serialize(device);
+        record.data_size = (uint64_t)(device.pos() - data_pos);
+        writePadding(device, (qint64)record.data_size);
+
+        const auto content_pos = device.pos();
+        fsp.serializeContent(device);
+        record.content_size = (uint64_t)(device.pos() - content_pos);
+        writePadding(device, (qint64)record.content_size);
+
+        const auto end_pos = device.pos();
+        device.seek(record_pos);
+        device.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        device.seek(end_pos);
+
+        ++header.record_count;
+    });
+
+    const auto end_pos = device.pos();
+    device.seek(0);
+    device.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    device.seek(end_pos);
+}
+
+}
+
 Plugin::Plugin():
-    homebrowser(fs_browsers_match_case_sensitive_,
+    homebrowser(fs_index_,
+                fs_browsers_match_case_sensitive_,
                 fs_browsers_show_hidden_,
                 fs_browsers_sort_case_insensitive_,
                 fs_browsers_show_dirs_first_),
-    rootbrowser(fs_browsers_match_case_sensitive_,
+    rootbrowser(fs_index_,
+                fs_browsers_match_case_sensitive_,
                 fs_browsers_show_hidden_,
                 fs_browsers_sort_case_insensitive_,
-                fs_browsers_show_dirs_first_)
+                fs_browsers_show_dirs_first_),
+    contentsearch(fs_index_)
 {
     ::apps = apps.get();
 
     connect(&fs_index_, &FsIndex::status, this, &Plugin::statusInfo);
-    connect(&fs_index_, &FsIndex::updatedFinished, this, &Plugin::updateIndexItems);
-    connect(this, &Plugin::index_file_path_changed, this, &Plugin::updateIndexItems);
+    connect(&fs_index_, &FsIndex::updatedFinished, this, &Plugin::onIndexUpdated);
 
     auto cache_path = cacheLocation();
     tryCreateDirectory(cache_path);
 
+    // Map the binary index, the trees are built right from the mapped memory. Eagerly, the index
+    // items need all nodes anyway. See RootNode::fromBinary.
+    map<QString, IndexRecord> records;
+    QFile index_file(cache_path/INDEX_FILE_NAME);
+    if (index_file.open(QIODevice::ReadOnly))
+    {
+        if (auto *data = index_file.map(0, index_file.size()); data)
+            records = readIndexFile(data, index_file.size());
+        else
+            WARN << "Failed mapping index file:" << index_file.errorString();
+    }
+
+    // Import the legacy JSON index if there is no binary index yet
     QJsonObject object;
-    if (QFile file(cache_path/INDEX_FILE_NAME); file.open(QIODevice::ReadOnly))
-        object = QJsonDocument(QJsonDocument::fromJson(file.readAll())).object();
+    if (records.empty())
+        if (QFile file(cache_path/LEGACY_INDEX_FILE_NAME); file.open(QIODevice::ReadOnly))
+            object = QJsonDocument(QJsonDocument::fromJson(file.readAll())).object();
 
     auto s = settings();
     restore_index_file_path(s);
@@ -67,13 +249,24 @@ Plugin::Plugin():
     restore_fs_browsers_sort_case_insensitive(s);
     restore_fs_browsers_show_dirs_first(s);
 
+    if (auto v = s->value(CFG_MAX_CONCURRENT_SCANS); v.isValid())
+        fs_index_.setMaxConcurrentScans(v.toUInt());
+
     auto paths = s->value(CFG_PATHS, QStringList()).toStringList();
 
     for (const auto &path : paths){
         auto fsp = make_unique<FsIndexPath>(path);
 
-        if (auto it = object.find(path); it != object.end())
-            fsp->deserialize(it.value().toObject());
+        if (auto rit = records.find(path); rit != records.end())
+            try {
+                fsp->deserialize(rit->second.data, rit->second.size);
+                fsp->restoreCheckpoint(rit->second.checkpoint);
+                fsp->deserializeContent(rit->second.content, rit->second.content_size);
+            } catch (const exception &e) {
+                WARN << QString("Discarding index of '%1': %2").arg(path, e.what());
+            }
+        else if (auto it = object.find(path); it != object.end())
+            fsp->fromJson(it.value().toObject());
 
         s->beginGroup(path);
         fsp->setFollowSymlinks(s->value(CFG_FOLLOW_SYMLINKS, DEF_FOLLOW_SYMLINKS).toBool());
@@ -82,12 +275,21 @@ Plugin::Plugin():
         fsp->setMimeFilters(s->value(CFG_MIME_FILTERS, DEF_MIME_FILTERS).toStringList());
         fsp->setMaxDepth(s->value(CFG_MAX_DEPTH, DEF_MAX_DEPTH).toUInt());
         fsp->setScanInterval(s->value(CFG_SCAN_INTERVAL, DEF_SCAN_INTERVAL).toUInt());
+        fsp->setScanThreads(s->value(CFG_SCAN_THREADS, DEF_SCAN_THREADS).toUInt());
+        fsp->setMimeResolution(static_cast<MimeResolution>(
+            min(s->value(CFG_MIME_RESOLUTION, (int)DEF_MIME_RESOLUTION).toInt(),
+                (int)MimeResolution::Content)));
+        fsp->setPriority(s->value(CFG_PRIORITY, DEF_PRIORITY).toInt());
+        fsp->setMaxScanRate(s->value(CFG_MAX_SCAN_RATE, DEF_MAX_SCAN_RATE).toUInt());
+        fsp->setContentIndexing(s->value(CFG_CONTENT_INDEX, DEF_CONTENT_INDEX).toBool());
         fsp->setWatchFilesystem(s->value(CFG_FS_WATCHES, DEF_FS_WATCHES).toBool());
         s->endGroup();
 
         fs_index_.addPath(::move(fsp));
     }
 
+    index_file.close();  // unmaps
+
     update_item = StandardItem::make(
         "scan_files",
         tr("Update index"),
@@ -95,15 +297,31 @@ Plugin::Plugin():
         {":app_icon"},
         {{"scan_files", tr("Scan"), [this](){ fs_index_.update(); }}}
     );
+
+    // Persist periodically, such that crashes do not lose the progress of long scans
+    connect(&persist_timer_, &QTimer::timeout, this, [this]{
+        if (persist_future_.isFinished())
+            persist_future_ = QtConcurrent::run([this]{ persistIndex(); });
+    });
+    persist_timer_.start(PERSIST_INTERVAL);
+
+    // Throttled scans back off while the launcher is in use
+    ScanThrottle::setForeground(QGuiApplication::applicationState() == Qt::ApplicationActive);
+    connect(qGuiApp, &QGuiApplication::applicationStateChanged,
+            this, [](Qt::ApplicationState state){
+                ScanThrottle::setForeground(state == Qt::ApplicationActive);
+            });
 }
 
 Plugin::~Plugin()
 {
+    persist_timer_.stop();
+    persist_future_.waitForFinished();
     fs_index_.disconnect();
+    fs_index_.stop();
 
     auto s = settings();
     QStringList paths;
-    QJsonObject object;
     for (auto &[path, fsp] : fs_index_.indexPaths()){
         paths << path;
         s->beginGroup(path);
@@ -114,40 +332,132 @@ Plugin::~Plugin()
         s->setValue(CFG_MAX_DEPTH, fsp->maxDepth());
         s->setValue(CFG_FS_WATCHES, fsp->watchFileSystem());
         s->setValue(CFG_SCAN_INTERVAL, fsp->scanInterval());
+        s->setValue(CFG_SCAN_THREADS, fsp->scanThreads());
+        s->setValue(CFG_MIME_RESOLUTION, (int)fsp->mimeResolution());
+        s->setValue(CFG_PRIORITY, fsp->priority());
+        s->setValue(CFG_MAX_SCAN_RATE, fsp->maxScanRate());
+        s->setValue(CFG_CONTENT_INDEX, fsp->contentIndexing());
         s->endGroup();
-        object.insert(path, fsp->serialize());
     }
     s->setValue(CFG_PATHS, paths);
 
-    if (QFile file(QDir(cacheLocation()).filePath(INDEX_FILE_NAME)); file.open(QIODevice::WriteOnly)) {
-        DEBG << "Storing file index to" << file.fileName();
-        file.write(QJsonDocument(object).toJson(QJsonDocument::Compact));
-        file.close();
-    } else
+    persistIndex();
+}
+
+void Plugin::persistIndex()
+{
+    // Skip if nothing changed since the last write
+    map<QString, tuple<uint64_t, QByteArray, uint64_t>> state;
+    fs_index_.forEachPath([&state](const FsIndexPath &fsp){
+        state.emplace(fsp.path(), make_tuple(fsp.generation(), fsp.checkpoint(),
+                                             fsp.contentRevision()));
+    });
+    if (state == persisted_state_)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Write to a temporary file and rename, a crash never leaves a truncated index behind
+    QSaveFile file(QDir(cacheLocation()).filePath(INDEX_FILE_NAME));
+    if (!file.open(QIODevice::WriteOnly))
         WARN << "Couldn't write to file:" << file.fileName();
+    else
+    {
+        writeIndexFile(file, fs_index_);
+        if (file.commit())
+        {
+            persisted_state_ = ::move(state);
+            QFile::remove(QDir(cacheLocation()).filePath(LEGACY_INDEX_FILE_NAME));
+            DEBG << QString("Stored file index to '%1' in %2 ms.")
+                        .arg(file.fileName()).arg(timer.elapsed());
+        }
+        else
+            WARN << "Failed storing file index:" << file.errorString();
+    }
 }
 
-vector<Extension*> Plugin::extensions() { return { this, &homebrowser, &rootbrowser }; }
+vector<Extension*> Plugin::extensions() { return { this, &homebrowser, &rootbrowser, &contentsearch }; }
+
+vector<RankItem> Plugin::handleGlobalQuery(const Query &query)
+{
+    ScanThrottle::notifyQuery();
+    auto results = IndexQueryHandler::handleGlobalQuery(query);
+
+    // File paths are not indexed but matched by walking the path components of the trees,
+    // e.g. "proj src main" matches proj/src/main.cpp. Single words match names only.
+    static const QRegularExpression separators(R"([\s/]+)");
+    if (index_file_path())
+        if (const auto tokens = query.string().split(separators, Qt::SkipEmptyParts);
+            tokens.size() > 1)
+            for (auto &[item, score] : fs_index_.matchPath(tokens, MAX_PATH_MATCHES,
+                                                           [&query]{ return !query.isValid(); }))
+                results.emplace_back(::move(item), score);
+
+    return results;
+}
+
+void Plugin::onIndexUpdated()
+{
+    // Publish only if any index path changed
+    const auto &paths = fs_index_.indexPaths();
+    if (index_items_.size() != paths.size()
+        || any_of(paths.begin(), paths.end(), [this](const auto &path){
+               auto it = index_items_.find(path.first);
+               return it == index_items_.end() || it->second.generation != path.second->generation();
+           }))
+        updateIndexItems();
+    else
+        DEBG << "File index unchanged, skipping publication.";
+}
 
 void Plugin::updateIndexItems()
 {
-    vector<IndexItem> ii;
+    QElapsedTimer timer;
+    timer.start();
+
+    const auto &paths = fs_index_.indexPaths();
+    for (auto it = index_items_.begin(); it != index_items_.end();)
+        if (paths.find(it->first) == paths.end())
+            it = index_items_.erase(it);
+        else
+            ++it;
 
-    // Get file items
-    for (auto &[path, fsp] : fs_index_.indexPaths())
+    size_t size = 0;
+    for (auto &[path, fsp] : paths)
     {
+        auto &cache = index_items_[path];
+        if (cache.generation == fsp->generation())
+        {
+            size += cache.items.size();
+            continue;
+        }
+
+        // Rebuild the index items of changed paths only
+        QElapsedTimer rebuild_timer;
+        rebuild_timer.start();
+
         vector<shared_ptr<FileItem>> items;
         fsp->items(items);
 
-        // Create index items
+        const auto previous_size = cache.items.size();
+        cache.items.clear();
+        cache.items.reserve(items.size());
         for (auto &file_item : items)
-        {
-            ii.emplace_back(file_item, file_item->name());
-            if (index_file_path())
-                ii.emplace_back(file_item, file_item->filePath());
-        }
+            cache.items.emplace_back(file_item, file_item->name());
+        cache.generation = fsp->generation();
+        size += cache.items.size();
+
+        DEBG << QString("Rebuilt %1 index items of '%2' (previously %3) in %4 ms.")
+                    .arg(cache.items.size()).arg(path).arg(previous_size)
+                    .arg(rebuild_timer.elapsed());
     }
 
+    vector<IndexItem> ii;
+    ii.reserve(size + 2);
+    for (const auto &[path, cache] : index_items_)
+        ii.insert(ii.end(), cache.items.begin(), cache.items.end());
+
     // Add update item
     ii.emplace_back(update_item, update_item->text());
 
@@ -177,7 +487,10 @@ void Plugin::updateIndexItems()
     );
     ii.emplace_back(item, item->text());
 
+    const auto item_count = ii.size();
     setIndexItems(::move(ii));
+
+    INFO << QString("Published %1 file index items in %2 ms.").arg(item_count).arg(timer.elapsed());
 }
 
 QWidget *Plugin::buildConfigWidget() { return new ConfigWidget(this); }
@@ -193,6 +506,11 @@ void Plugin::addPath(const QString &path)
     fsp->setMimeFilters(DEF_MIME_FILTERS);
     fsp->setMaxDepth(DEF_MAX_DEPTH);
     fsp->setScanInterval(DEF_SCAN_INTERVAL);
+    fsp->setScanThreads(DEF_SCAN_THREADS);
+    fsp->setMimeResolution(DEF_MIME_RESOLUTION);
+    fsp->setPriority(DEF_PRIORITY);
+    fsp->setMaxScanRate(DEF_MAX_SCAN_RATE);
+    fsp->setContentIndexing(DEF_CONTENT_INDEX);
     fsp->setWatchFilesystem(DEF_FS_WATCHES);
     fs_index_.addPath(::move(fsp));
 }
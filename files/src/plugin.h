@@ -1,10 +1,13 @@
 // Copyright (c) 2022-2024 Manuel Schneider
 
 #pragma once
+#include "contentsearch.h"
 #include "filebrowsers.h"
 #include "fsindex.h"
+#include <QFuture>
 #include <QObject>
 #include <QSettings>
+#include <QTimer>
 #include <albert/extensionplugin.h>
 #include <albert/indexqueryhandler.h>
 #include <albert/plugin/applications.h>
@@ -27,6 +30,7 @@ public:
     ~Plugin();
 
     std::vector<albert::Extension*> extensions() override;
+    std::vector<albert::RankItem> handleGlobalQuery(const albert::Query &) override;
     QWidget *buildConfigWidget() override;
     void updateIndexItems() override;
 
@@ -36,11 +40,26 @@ public:
 
 private:
 
+    void onIndexUpdated();
+    void persistIndex();  // thread-safe, not reentrant
+
+    // Index items of an index path, rebuilt only if the path changed
+    struct IndexItems
+    {
+        uint64_t generation = 0;
+        std::vector<albert::IndexItem> items;
+    };
+
     albert::StrongDependency<applications::Plugin> apps{"applications"};
     FsIndex fs_index_;
+    std::map<QString, IndexItems> index_items_;
+    std::map<QString, std::tuple<uint64_t, QByteArray, uint64_t>> persisted_state_;  // see persistIndex
+    QTimer persist_timer_;
+    QFuture<void> persist_future_;
     std::shared_ptr<albert::Item> update_item;
     HomeBrowser homebrowser;
     RootBrowser rootbrowser;
+    ContentSearchHandler contentsearch;
 
 signals:
 
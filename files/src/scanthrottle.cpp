@@ -0,0 +1,111 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "scanthrottle.h"
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <thread>
+#if defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+using namespace std::chrono;
+
+static const qint64 SLEEP_SLICE = 100;  // ms, abort latency
+static const qint64 QUERY_BACKOFF = 1000;  // ms after the last query
+static const qint64 MAX_CREDIT = 1000;  // ms a slow scan may catch up on
+static const int BACKGROUND_NICE = 10;
+
+static atomic_bool foreground = false;
+static atomic<int64_t> last_query = 0;  // ms since the steady clock epoch
+
+static int64_t now() { return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count(); }
+
+static bool backingOff() { return foreground || now() - last_query < QUERY_BACKOFF; }
+
+static bool sleepFor(qint64 ms, const atomic_bool &abort)
+{
+    this_thread::sleep_for(milliseconds(min(ms, SLEEP_SLICE)));
+    return !abort.load(memory_order_relaxed);
+}
+
+ScanThrottle::ScanThrottle(uint max_dirs_per_second, function<void(const QString&)> &status):
+    max_rate_(max(max_dirs_per_second, 1u)), status_(status)
+{ timer_.start(); }
+
+bool ScanThrottle::acquire(const atomic_bool &abort)
+{
+    unique_lock lock(mutex_);  // serializes the threads of the scan, they share the budget
+
+    if (backingOff())
+    {
+        status_(tr("Scan paused while in use."));
+        while (backingOff())
+            if (!sleepFor(SLEEP_SLICE, abort))
+                return false;
+
+        // Do not catch up on the time spent backing off
+        base_time_ = timer_.elapsed();
+        base_count_ = count_;
+    }
+
+    // Do not accumulate credit while scanning slower than the limit
+    const auto elapsed = timer_.elapsed();
+    if (const auto due = base_time_ + (qint64)((count_ - base_count_) * 1000 / max_rate_);
+        elapsed - due > MAX_CREDIT)
+    {
+        base_time_ = elapsed - MAX_CREDIT;
+        base_count_ = count_;
+    }
+
+    ++count_;
+    const auto due = base_time_ + (qint64)((count_ - base_count_) * 1000 / max_rate_);
+    for (auto t = timer_.elapsed(); t < due; t = timer_.elapsed())
+        if (!sleepFor(due - t, abort))
+            return false;
+
+    if (const auto t = timer_.elapsed(); t - report_time_ >= 1000)
+    {
+        status_(tr("Scanning at %1 directories/s (max %2).")
+                    .arg((count_ - report_count_) * 1000 / (t - report_time_)).arg(max_rate_));
+        report_time_ = t;
+        report_count_ = count_;
+    }
+
+    return true;
+}
+
+void ScanThrottle::setForeground(bool active) { foreground = active; }
+
+void ScanThrottle::notifyQuery() { last_query = now(); }
+
+void runInBackground(const function<void()> &fn)
+{
+    exception_ptr exception;
+    unique_ptr<QThread> thread(QThread::create([&]{
+#if defined(Q_OS_LINUX)
+        // Thread attributes on Linux. glibc has no ioprio wrappers, see ioprio_set(2).
+        const auto tid = (id_t)syscall(SYS_gettid);
+        errno = 0;
+        if (const auto nice = getpriority(PRIO_PROCESS, tid); errno == 0 && nice < BACKGROUND_NICE)
+            setpriority(PRIO_PROCESS, tid, BACKGROUND_NICE);
+        const int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3, IOPRIO_CLASS_SHIFT = 13;
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+        try {
+            fn();
+        } catch (...) {
+            exception = current_exception();
+        }
+    }));
+    thread->start(QThread::LowPriority);
+    thread->wait();
+    if (exception)
+        rethrow_exception(exception);
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#pragma once
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+///
+/// Limits the directories per second of a scan
+///
+/// Shared by all threads of a scan. Additionally backs off while the user
+/// interacts with the launcher, i.e. while the application is active or
+/// shortly after a query. Reports the achieved rate through status once per
+/// second.
+///
+class ScanThrottle
+{
+    Q_DECLARE_TR_FUNCTIONS(ScanThrottle)
+public:
+    ScanThrottle(uint max_dirs_per_second, std::function<void(const QString&)> &status);
+
+    /// Blocks until the next directory may be scanned. Thread-safe.
+    /// @returns false if aborted meanwhile
+    bool acquire(const std::atomic_bool &abort);
+
+    static void setForeground(bool active);
+    static void notifyQuery();
+
+private:
+    const uint max_rate_;
+    std::function<void(const QString&)> &status_;
+    std::mutex mutex_;
+    QElapsedTimer timer_;
+    uint64_t count_ = 0;
+    qint64 base_time_ = 0;  // rate basis, reset after backing off
+    uint64_t base_count_ = 0;
+    qint64 report_time_ = 0;
+    uint64_t report_count_ = 0;
+};
+
+/// Runs fn on a thread of low CPU and, on Linux, idle I/O priority and waits for it to finish.
+/// Threads started by fn inherit the priorities. Rethrows exceptions of fn.
+void runInBackground(const std::function<void()> &fn);
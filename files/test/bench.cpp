@@ -0,0 +1,425 @@
+// Copyright (c) 2026 Manuel Schneider
+
+#include "bench.h"
+#include "dirlisting.h"
+#include "fileitems.h"
+#include "fsindexnodes.h"
+#include "fsindexpath.h"
+#include <QBuffer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <albert/indexitem.h>
+#include <limits>
+#include <sys/resource.h>
+#include <unistd.h>
+using namespace std;
+
+
+QTEST_APPLESS_MAIN(FilesBenchmarks)
+
+
+static uint envOr(const char *name, uint def)
+{
+    bool ok;
+    auto v = qEnvironmentVariable(name).toUInt(&ok);
+    return ok ? v : def;
+}
+
+static qint64 residentMemory()
+{
+    // Linux only. Second field of statm is the resident set size in pages.
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    return file.readAll().split(' ').value(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+static qint64 peakResidentMemory()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return (qint64)usage.ru_maxrss * 1024;  // KiB on Linux
+}
+
+// Synthetic tree, configurable by environment variables
+static struct TreeParameters
+{
+    uint depth = envOr("FILES_BENCH_DEPTH", 4);
+    uint fan_out = envOr("FILES_BENCH_FAN_OUT", 6);
+    uint files = envOr("FILES_BENCH_FILES", 20);
+    uint loops = envOr("FILES_BENCH_LOOPS", 0);  // leaf dirs linking back to the root
+    uint hidden_ratio = envOr("FILES_BENCH_HIDDEN", 10);  // percent of hidden entries
+} params;
+
+// Spreads hidden entries evenly
+static QString entryName(const char *prefix, uint i)
+{
+    const bool hidden = (i * params.hidden_ratio) / 100 != ((i + 1) * params.hidden_ratio) / 100;
+    return QString("%1%2_%3").arg(hidden ? "." : "", prefix).arg(i);
+}
+
+static void createTree(const QString &root_path, const QString &path, uint depth, uint &loops)
+{
+    QDir dir(path);
+    for (uint i = 0; i < params.files; ++i)
+        if (QFile file(dir.filePath(entryName("file", i) + ".txt")); file.open(QIODevice::WriteOnly))
+            file.write("test");
+
+    if (depth > 0)
+        for (uint i = 0; i < params.fan_out; ++i)
+        {
+            auto name = entryName("dir", i);
+            dir.mkdir(name);
+            createTree(root_path, dir.filePath(name), depth - 1, loops);
+        }
+    else if (loops > 0)
+    {
+        QFile::link(root_path, dir.filePath("loop"));
+        --loops;
+    }
+}
+
+// What the scanner did before the listing fast path
+static uint walkQDir(const QString &path)
+{
+    uint count = 1;
+    for (const auto &fi : QDir(path).entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot,
+                                                   QDir::Name))
+    {
+        (void)fi.lastModified();
+        if (fi.isDir() && !fi.isSymLink())
+        {
+            (void)fi.canonicalFilePath();
+            count += walkQDir(fi.filePath());
+        }
+    }
+    return count;
+}
+
+static uint walkListing(const QString &path)
+{
+    uint count = 1;
+    for (const auto &entry : listDirectory(path, false))
+        if (entry.is_dir && !entry.is_symlink)
+        {
+            const auto file_path = QString("%1/%2").arg(path, entry.name);
+            FileStat stat;
+            (void)statFile(file_path, stat);
+            count += walkListing(file_path);
+        }
+    return count;
+}
+
+// Typical exclusions of a home directory
+static vector<NameFilter> nameFilters()
+{
+    vector<NameFilter> filters;
+    for (const auto &pattern : {
+             "node_modules", "\\.git/", "\\.svn/", "\\.hg/", "__pycache__", "\\.pyc$",
+             "\\.o$", "\\.a$", "\\.so$", "\\.class$", "^\\.cache", "^\\.local/share/Trash",
+             "^\\.npm", "^\\.cargo/registry", "^\\.rustup", "^\\.gradle", "^\\.m2",
+             "/target/", "/build/", "/dist/", "/\\.venv/", "/venv/", "/\\.tox/",
+             "\\.swp$", "~$", "\\.tmp$", "\\.log$", "\\.DS_Store$", "/\\.idea/",
+             "/\\.vscode/", "cmake-build-[a-z]+/", "\\.egg-info/", "/\\.mypy_cache/",
+             "/\\.pytest_cache/", "\\.(bak|orig|rej)$", "/[0-9a-f]{40}$", "^snap/",
+             "!^\\.local/share/applications", "!\\.gitignore$", "!/build/keep/"})
+        filters.emplace_back(QString(pattern));
+    return filters;
+}
+
+static QStringList relativePaths()
+{
+    QStringList paths;
+    for (const auto &dir : {"Documents/projects/albert", "src/app/node_modules/lodash",
+                            ".local/share/applications", "code/build/CMakeFiles",
+                            ".cache/thumbnails/large", "Pictures/2024/holidays"})
+        for (const auto &file : {"main.cpp", "README.md", "index.js", "photo_0001.jpg",
+                                 "module.o", "notes.txt.swp", ".gitignore", "data.log"})
+            paths << QString("%1/%2").arg(dir, file);
+    return paths;
+}
+
+// Timings are reported by QTest in any of its formats, e.g. -o results.xml,junitxml.
+// Values QTest can not report (item counts, memory) are appended as JSON lines to the
+// file in FILES_BENCH_REPORT, along with the tree parameters.
+static void report(const QString &benchmark, const QJsonObject &values)
+{
+    const auto path = qEnvironmentVariable("FILES_BENCH_REPORT");
+    if (path.isEmpty())
+        return;
+
+    QJsonObject line(values);
+    line.insert("benchmark", benchmark);
+    line.insert("depth", (qint64)params.depth);
+    line.insert("fan_out", (qint64)params.fan_out);
+    line.insert("files", (qint64)params.files);
+    line.insert("loops", (qint64)params.loops);
+    line.insert("hidden_ratio", (qint64)params.hidden_ratio);
+
+    if (QFile file(path); file.open(QIODevice::WriteOnly | QIODevice::Append))
+        file.write(QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n');
+    else
+        qWarning() << "Failed to open report file" << path;
+}
+
+static unique_ptr<FsIndexPath> makeIndexPath(const QString &path)
+{
+    auto p = make_unique<FsIndexPath>(path);
+    p->setMimeFilters({"*"});
+    p->setMimeResolution(MimeResolution::Extension);
+    p->setFollowSymlinks(params.loops > 0);
+    return p;
+}
+
+void FilesBenchmarks::initTestCase()
+{
+    QVERIFY(root.isValid());
+
+    uint loops = params.loops;
+    createTree(root.path(), root.path(), params.depth, loops);
+
+    index_path = makeIndexPath(root.path());
+    index_path->update(false, [](const QString &) {});
+
+    vector<shared_ptr<FileItem>> items;
+    index_path->items(items);
+    qInfo().noquote() << QString("Synthetic tree: depth %1, fan out %2, %3 files per dir, "
+                                 "%4 loops, %5% hidden, %6 items indexed.")
+                             .arg(params.depth).arg(params.fan_out).arg(params.files)
+                             .arg(params.loops).arg(params.hidden_ratio).arg(items.size());
+}
+
+void FilesBenchmarks::cleanupTestCase()
+{
+    index_path.reset();
+
+    const auto peak = peakResidentMemory();
+    qInfo().noquote() << QString("Peak resident memory: %1 KiB").arg(peak / 1024);
+    report("peak_rss", {{"bytes", peak}});
+}
+
+void FilesBenchmarks::update_cold()
+{
+    // Cold in terms of the index. Dropping the page cache needs root.
+    QBENCHMARK {
+        auto p = makeIndexPath(root.path());
+        p->update(false, [](const QString &) {});
+    }
+}
+
+void FilesBenchmarks::update_warm()
+{
+    QBENCHMARK {
+        index_path->update(false, [](const QString &) {});
+    }
+}
+
+void FilesBenchmarks::sweep()
+{
+    // The stat phase of no-op rescans, in parallel vs sequential
+    auto tree = RootNode::make(root.path());
+    IndexSettings settings;
+    settings.root_path = root.path();
+    settings.max_depth = 255;
+    settings.index_hidden_files = true;
+    settings.follow_symlinks = params.loops > 0;
+    settings.forced = false;
+    settings.mime_resolution = MimeResolution::Extension;
+    const atomic_bool abort = false;
+    function<void(const QString&)> status = [](const QString &) {};
+    {
+        IndexState state{abort, status};
+        tree->update(tree, settings, state, 1);
+    }
+
+    for (const auto threads : {1, QThread::idealThreadCount()})
+    {
+        QElapsedTimer timer;
+        timer.start();
+        IndexState state{abort, status};
+        const auto modified = tree->sweep(state, threads);
+        const auto elapsed = timer.nsecsElapsed();
+        qInfo().noquote() << QString("Swept %1 directories in %2 ms using %3 threads")
+                                 .arg(state.indexed_dirs.size()).arg(elapsed / 1e6).arg(threads);
+        report("sweep", {{"threads", threads},
+                         {"dirs", (qint64)state.indexed_dirs.size()},
+                         {"ns", elapsed}});
+        QVERIFY(modified.empty());
+    }
+
+    QBENCHMARK {
+        IndexState state{abort, status};
+        tree->sweep(state, QThread::idealThreadCount());
+    }
+}
+
+void FilesBenchmarks::update_forced()
+{
+    auto p = makeIndexPath(root.path());
+    QBENCHMARK {
+        p->setNameFilters({});  // forces a full update
+        p->update(false, [](const QString &) {});
+    }
+}
+
+void FilesBenchmarks::items_collect()
+{
+    size_t count = 0;
+    QBENCHMARK {
+        vector<shared_ptr<FileItem>> items;
+        index_path->items(items);
+        count = items.size();
+    }
+    report("items_collect", {{"items", (qint64)count}});
+}
+
+void FilesBenchmarks::index_items_build()
+{
+    // What Plugin::updateIndexItems does per changed path. File paths are matched by
+    // walking the tree instead, see path_match.
+    vector<shared_ptr<FileItem>> items;
+    index_path->items(items);
+
+    QBENCHMARK {
+        vector<albert::IndexItem> index_items;
+        index_items.reserve(items.size());
+        for (auto &item : items)
+            index_items.emplace_back(item, item->name());
+    }
+    report("index_items_build", {{"items", (qint64)items.size()}});
+}
+
+void FilesBenchmarks::path_match()
+{
+    // Worst case, the entire tree is walked
+    const QStringList tokens{"dir", "file"};
+    size_t count = 0;
+    QBENCHMARK {
+        vector<pair<shared_ptr<FileItem>, double>> results;
+        index_path->matchPath(tokens, results, numeric_limits<size_t>::max(), []{ return false; });
+        count = results.size();
+    }
+    report("path_match", {{"matches", (qint64)count}});
+}
+
+void FilesBenchmarks::index_load_json()
+{
+    const auto json = QJsonDocument(index_path->toJson()).toJson(QJsonDocument::Compact);
+    FsIndexPath p(root.path());
+    QBENCHMARK {
+        p.fromJson(QJsonDocument::fromJson(json).object());
+    }
+}
+
+void FilesBenchmarks::index_load_binary()
+{
+    QFile file(QDir(root.path()).filePath("index.bin"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    index_path->serialize(file);
+    file.close();
+
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const auto *data = file.map(0, file.size());
+    QVERIFY(data);
+
+    FsIndexPath p(root.path());
+    QBENCHMARK {
+        p.deserialize(data, file.size());
+    }
+}
+
+void FilesBenchmarks::index_store_json()
+{
+    QBENCHMARK {
+        auto json = QJsonDocument(index_path->toJson()).toJson(QJsonDocument::Compact);
+        Q_UNUSED(json)
+    }
+}
+
+void FilesBenchmarks::index_store_binary()
+{
+    QBENCHMARK {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        index_path->serialize(buffer);
+    }
+}
+
+void FilesBenchmarks::scan_qdir()
+{
+    uint count = 0;
+    QBENCHMARK {
+        count = walkQDir(root.path());
+    }
+    qInfo().noquote() << QString("Walked %1 directories").arg(count);
+}
+
+void FilesBenchmarks::scan_listing()
+{
+    uint count = 0;
+    QBENCHMARK {
+        count = walkListing(root.path());
+    }
+    qInfo().noquote() << QString("Walked %1 directories").arg(count);
+}
+
+void FilesBenchmarks::name_filters_regex()
+{
+    const auto filters = nameFilters();
+    const auto paths = relativePaths();
+    uint excluded = 0;
+    QBENCHMARK {
+        excluded = 0;
+        for (const auto &path : paths)
+        {
+            auto exclude = false;
+            for (const auto &filter : filters)
+                if (((exclude && filter.type == PatternType::Include)
+                     || (!exclude && filter.type == PatternType::Exclude))
+                    && filter.regex.match(path).hasMatch())
+                    exclude = !exclude;
+            excluded += exclude;
+        }
+    }
+    qInfo().noquote() << QString("Excluded %1 of %2 paths").arg(excluded).arg(paths.size());
+}
+
+void FilesBenchmarks::name_filters_matcher()
+{
+    const NameFilterMatcher matcher(nameFilters());
+    const auto paths = relativePaths();
+    uint excluded = 0;
+    QBENCHMARK {
+        excluded = 0;
+        for (const auto &path : paths)
+            excluded += matcher.excludes(path);
+    }
+    qInfo().noquote() << QString("Excluded %1 of %2 paths").arg(excluded).arg(paths.size());
+}
+
+void FilesBenchmarks::index_memory()
+{
+    const auto before = residentMemory();
+
+    auto p = makeIndexPath(root.path());
+    p->update(false, [](const QString &) {});
+    const auto tree = residentMemory();
+
+    vector<shared_ptr<FileItem>> items;
+    p->items(items);
+    const auto published = residentMemory();
+
+    report("index_memory", {{"items", (qint64)items.size()},
+                            {"tree_bytes", tree - before},
+                            {"items_bytes", published - tree}});
+
+    qInfo().noquote() << QString("Resident memory for %1 items: tree %2 KiB, items %3 KiB")
+                             .arg(items.size())
+                             .arg((tree - before) / 1024)
+                             .arg((published - tree) / 1024);
+}
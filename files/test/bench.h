@@ -0,0 +1,40 @@
+// Copyright (c) 2026 Manuel Schneider
+#include <QCoreApplication>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+#include <memory>
+class FsIndexPath;
+
+class FilesBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+    void cleanupTestCase();
+
+    void update_cold();
+    void update_warm();
+    void sweep();
+    void update_forced();
+    void items_collect();
+    void index_items_build();
+    void path_match();
+
+    void index_load_json();
+    void index_load_binary();
+    void index_store_json();
+    void index_store_binary();
+    void index_memory();
+    void scan_qdir();
+    void scan_listing();
+    void name_filters_regex();
+    void name_filters_matcher();
+
+private:
+
+    QTemporaryDir root;
+    std::unique_ptr<FsIndexPath> index_path;
+
+};
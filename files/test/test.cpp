@@ -2,10 +2,19 @@
 
 #include "fileitems.h"
 #include "fsindex.h"
+#include "fsindexnodes.h"
 #include "fsindexpath.h"
 #include "test.h"
+#if defined(Q_OS_LINUX)
+#include "inotifywatcher.h"
+#endif
+#include <QBuffer>
 #include <QFile>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QSignalSpy>
 #include <QTemporaryDir>
+#include <QThread>
 using namespace std;
 
 
@@ -92,6 +101,13 @@ void FilesTests::fs_index_path()
     QCOMPARE(items.size(),  6);
     p->setFollowSymlinks(false);
 
+    // parallel scan
+    p->setScanThreads(4);
+    p->setMimeFilters({"inode/directory", "text/plain"});
+    update();
+    QCOMPARE(items.size(),  6);
+    p->setScanThreads(1);
+
     // namefilters
     p->setNameFilters({"b"});
     update();
@@ -130,6 +146,441 @@ void FilesTests::fs_index_path()
     QCOMPARE(items.size(),  3);
 }
 
+void FilesTests::fs_index_path_serialization()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkpath("a/b"));
+
+    for (const auto &path : {"a/foo.txt", "a/b/bar.txt", "baz.txt"})
+    {
+        QFile file(root.filePath(path));
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+        file.write("test");
+    }
+
+    auto filePaths = [](const FsIndexPath &p)
+    {
+        vector<shared_ptr<FileItem>> items;
+        p.items(items);
+        QStringList paths;
+        for (const auto &item : items)
+            paths << QString("%1 %2").arg(item->filePath(), item->mimeType().name());
+        paths.sort();
+        return paths;
+    };
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"inode/directory", "text/plain"});
+    p.update(false, [](const QString &) {});
+    const auto expected = filePaths(p);
+    QCOMPARE(expected.size(), 6);
+
+    // binary
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    p.serialize(buffer);
+    buffer.close();
+    const auto *data = reinterpret_cast<const uchar*>(buffer.data().constData());
+
+    FsIndexPath b(root.path());
+    b.deserialize(data, buffer.size());
+    QCOMPARE(filePaths(b), expected);
+
+    // truncated binary
+    bool thrown = false;
+    try {
+        FsIndexPath t(root.path());
+        t.deserialize(data, buffer.size() - 1);
+    } catch (const runtime_error &) {
+        thrown = true;
+    }
+    QVERIFY(thrown);
+
+    // json
+    FsIndexPath j(root.path());
+    j.fromJson(p.toJson());
+    QCOMPARE(filePaths(j), expected);
+}
+
+void FilesTests::fs_index_path_mime_resolution()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+    QVERIFY(QDir(root.path()).mkdir("d"));
+
+    for (const auto &path : {"foo.txt", "noext", "CMakeLists.txt"})
+    {
+        QFile file(root.filePath(path));
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+        file.write("test");
+    }
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"inode/directory", "text/*", "application/*"});
+
+    auto mimeTypes = [&](MimeResolution resolution)
+    {
+        p.setMimeResolution(resolution);
+        p.update(false, [](const QString &) {});
+        vector<shared_ptr<FileItem>> items;
+        p.items(items);
+        map<QString, QString> result;
+        for (const auto &item : items)
+            result.emplace(item->name(), item->mimeType().name());
+        return result;
+    };
+
+    auto m = mimeTypes(MimeResolution::Content);
+    QCOMPARE(m.size(), 5);
+    QCOMPARE(m["d"], "inode/directory");
+    QCOMPARE(m["foo.txt"], "text/plain");
+    QCOMPARE(m["noext"], "text/plain");
+    QCOMPARE(m["CMakeLists.txt"], "text/x-cmake");
+
+    m = mimeTypes(MimeResolution::Extension);
+    QCOMPARE(m.size(), 5);
+    QCOMPARE(m["d"], "inode/directory");
+    QCOMPARE(m["foo.txt"], "text/plain");
+    QCOMPARE(m["noext"], "application/octet-stream");
+    QCOMPARE(m["CMakeLists.txt"], "text/x-cmake");  // whole name globs take precedence
+
+    // Unknown types are sniffed, the filters depend on them
+    p.setMimeFilters({"inode/directory", "text/*"});
+    m = mimeTypes(MimeResolution::Lazy);
+    QCOMPARE(m.size(), 5);
+    QCOMPARE(m["foo.txt"], "text/plain");
+    QCOMPARE(m["noext"], "text/plain");
+
+    p.setMimeFilters({"inode/directory", "application/*"});
+    m = mimeTypes(MimeResolution::Lazy);
+    QCOMPARE(m.size(), 2);
+    QVERIFY(!m.contains("noext"));
+
+    // Unknown types are sniffed on access, if the filters accept all types
+    p.setMimeFilters({"*"});
+    m = mimeTypes(MimeResolution::Lazy);
+    QCOMPARE(m.size(), 5);
+    QCOMPARE(m["noext"], "text/plain");
+}
+
+void FilesTests::fs_index_path_checkpoint()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    for (const auto &path : {"a/x", "b/x", "c"})
+        QVERIFY(dir.mkpath(path));
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"inode/directory"});
+
+    auto itemCount = [&]
+    {
+        vector<shared_ptr<FileItem>> items;
+        p.items(items);
+        return items.size();
+    };
+
+    // Interrupt the scan at c, subtrees a and b are completed
+    atomic_bool abort = false;
+    p.update(abort, [&](const QString &s) { if (s.endsWith("/c")) abort = true; });
+    const auto checkpoint = p.checkpoint();
+    QVERIFY(!checkpoint.isEmpty());
+    QCOMPARE(itemCount(), 6);
+
+    FsIndexPath r(root.path());
+    r.restoreCheckpoint(checkpoint);
+    QCOMPARE(r.checkpoint(), checkpoint);
+
+    // The resumed scan rescans a, since its root has been modified, but skips b
+    QThread::sleep(1);  // mdates have a resolution of seconds
+    QVERIFY(dir.mkdir("a/d"));
+    QVERIFY(dir.mkdir("b/x/y"));
+    p.update(false, [](const QString &) {});
+    QVERIFY(p.checkpoint().isEmpty());
+    QCOMPARE(itemCount(), 7);
+
+    // Subsequent scans do not skip
+    p.update(false, [](const QString &) {});
+    QCOMPARE(itemCount(), 8);
+}
+
+void FilesTests::fs_index_path_content()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkdir("a"));
+
+    auto write = [&](const QString &path, const QByteArray &content)
+    {
+        QFile file(dir.filePath(path));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content);
+    };
+    write("x.txt", "The quick brown fox");
+    write("a/y.txt", "jumps over the lazy dog");
+    write("a/z.bin", QByteArray("the lazy dog\0", 13));
+
+    FsIndexPath p(root.path());
+    p.setMimeResolution(MimeResolution::Extension);
+    p.setContentIndexing(true);
+    p.update(false, [](const QString &) {});
+
+    auto find = [&](const QString &text)
+    {
+        auto paths = p.findContent(text, 10, {});
+        sort(paths.begin(), paths.end());
+        return paths;
+    };
+    QCOMPARE(find("QUICK brown"), vector<QString>{dir.filePath("x.txt")});
+    QCOMPARE(find("lazy dog"), vector<QString>{dir.filePath("a/y.txt")});
+    QCOMPARE(find("brown dog"), vector<QString>{});
+
+    // Unforced updates catch modifications of the same size within the same second
+    {
+        const auto mtime = QFileInfo(dir.filePath("x.txt")).lastModified();
+        write("x.txt", "The quick brown cat");
+        QFile file(dir.filePath("x.txt"));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(mtime.addMSecs(1), QFileDevice::FileModificationTime));
+    }
+    write("a/w.txt", "jumps over the quick cat");
+    QVERIFY(QFile::remove(dir.filePath("a/y.txt")));
+    p.update(false, [](const QString &) {});
+    QCOMPARE(find("brown cat"), vector<QString>{dir.filePath("x.txt")});
+    QCOMPARE(find("quick cat"), vector<QString>{dir.filePath("a/w.txt")});
+    QCOMPARE(find("fox"), vector<QString>{});
+    QCOMPARE(find("lazy"), vector<QString>{});
+
+    // Forced updates reread everything
+    write("x.txt", "The lazy brown dog");
+    QVERIFY(QFile::remove(dir.filePath("a/w.txt")));
+    p.setContentIndexing(false);
+    p.setContentIndexing(true);  // forced
+    p.update(false, [](const QString &) {});
+    QCOMPARE(find("lazy"), vector<QString>{dir.filePath("x.txt")});
+    QCOMPARE(find("quick"), vector<QString>{});
+
+    // Serialization
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::ReadWrite));
+    p.serializeContent(buffer);
+    FsIndexPath r(root.path());
+    r.deserializeContent(reinterpret_cast<const uchar*>(buffer.data().constData()), buffer.size());
+    r.setContentIndexing(true);
+    QCOMPARE(r.findContent("brown", 10, {}), vector<QString>{dir.filePath("x.txt")});
+}
+
+void FilesTests::fs_index_path_sweep()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkpath("a/b/c"));
+    QVERIFY(dir.mkdir("d"));
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"inode/directory"});
+    p.setFollowSymlinks(true);
+
+    auto itemCount = [&]
+    {
+        vector<shared_ptr<FileItem>> items;
+        p.items(items);
+        return items.size();
+    };
+
+    p.update(false, [](const QString &) {});
+    QCOMPARE(itemCount(), 5);
+
+    // Modifications do not change the mdates of the ancestors
+    QThread::sleep(1);  // mdates have a resolution of seconds
+    QVERIFY(dir.mkdir("a/b/c/e"));
+    QVERIFY(QFile::link(root.path(), dir.filePath("d/loop")));
+    p.update(false, [](const QString &) {});
+    QCOMPARE(itemCount(), 7);
+
+    // Same as the traversal
+    p.setIndexHidden(false);  // forced
+    p.update(false, [](const QString &) {});
+    QCOMPARE(itemCount(), 7);
+}
+
+void FilesTests::fs_index_path_list_directories()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkpath("a/b"));
+    QVERIFY(dir.mkdir("c"));
+    QVERIFY(dir.mkdir(".h"));
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"inode/directory"});
+
+    auto list = [&](const QString &path, bool hidden)
+    {
+        vector<QString> names;
+        if (!p.listDirectories(path, hidden, names))
+            return QStringList{"unlisted"};
+        sort(names.begin(), names.end());
+        return QStringList(names.begin(), names.end());
+    };
+
+    QCOMPARE(list(root.path(), false), QStringList{"unlisted"});  // not scanned yet
+
+    p.update(false, [](const QString &) {});
+    QCOMPARE(list(root.path(), false), QStringList({"a", "c"}));
+    QCOMPARE(list(dir.filePath("a"), false), QStringList{"b"});
+    QCOMPARE(list(root.path(), true), QStringList{"unlisted"});  // hidden not indexed
+
+    p.setIndexHidden(true);
+    p.update(false, [](const QString &) {});
+    QCOMPARE(list(root.path(), true), QStringList({".h", "a", "c"}));
+
+    p.setMaxDepth(1);
+    p.update(false, [](const QString &) {});
+    QCOMPARE(list(root.path(), false), QStringList({".h", "a", "c"}));
+    QCOMPARE(list(dir.filePath("a"), false), QStringList{"unlisted"});  // beyond max depth
+
+    p.setMaxDepth(255);
+    p.setNameFilters({"c"});
+    p.update(false, [](const QString &) {});
+    QCOMPARE(list(root.path(), false), QStringList{"unlisted"});  // excluded directories
+}
+
+void FilesTests::fs_index_path_match()
+{
+    QTemporaryDir root;
+    QVERIFY(root.isValid());
+
+    QDir dir(root.path());
+    for (const auto &path : {"proj/src/main.cpp", "proj/doc/main.md", "proj/aux/maintenance.txt",
+                             "other/src/main.cpp"})
+    {
+        QVERIFY(dir.mkpath(QFileInfo(dir.filePath(path)).path()));
+        QFile file(dir.filePath(path));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    FsIndexPath p(root.path());
+    p.setMimeFilters({"*"});
+    p.update(false, [](const QString &) {});
+
+    auto match = [&](const QStringList &tokens, size_t max_results = 10)
+    {
+        vector<pair<shared_ptr<FileItem>, double>> results;
+        p.matchPath(tokens, results, max_results, []{ return false; });
+        QStringList paths;
+        for (const auto &[item, score] : results)
+            paths << QString(item->filePath()).remove(0, root.path().size() + 1);
+        paths.sort();
+        return paths;
+    };
+
+    QCOMPARE(match({"proj", "src", "main"}), QStringList{"proj/src/main.cpp"});
+    QCOMPARE(match({"PR", "MAIN"}), QStringList({"proj/aux/maintenance.txt", "proj/doc/main.md",
+                                                 "proj/src/main.cpp"}));
+    QCOMPARE(match({"src", "main"}), QStringList({"other/src/main.cpp", "proj/src/main.cpp"}));
+    QCOMPARE(match({"proj", "src"}), QStringList{"proj/src"});
+    QCOMPARE(match({"src", "proj", "main"}), QStringList{});  // in order
+    QCOMPARE(match({QFileInfo(root.path()).fileName(), "doc"}), QStringList{"proj/doc"});
+
+    // Ranked before capped, aux is traversed first
+    QCOMPARE(match({"proj", "main"}, 1), QStringList{"proj/doc/main.md"});
+
+    // Modifications are picked up
+    QThread::sleep(1);  // mdates have a resolution of seconds
+    QVERIFY(dir.mkdir("proj/src/main"));
+    p.update(false, [](const QString &) {});
+    QCOMPARE(match({"proj", "src", "main"}), QStringList({"proj/src/main", "proj/src/main.cpp"}));
+}
+
+void FilesTests::name_filter_matcher()
+{
+    const QStringList patterns{
+        "node_modules",     // literal
+        "^build",           // prefix
+        "\\.o$",          // suffix
+        "^a/b$",            // exact
+        "!^build/keep",     // include
+        "\\.cache/",      // escaped literal
+        "[0-9]+\\.log$",  // regex
+        "(x)\\1",         // backreference
+        "!keep",
+        "tmp"
+    };
+
+    vector<NameFilter> filters;
+    for (const auto &pattern : patterns)
+        filters.emplace_back(pattern);
+    NameFilterMatcher matcher(filters);
+
+    // Reference: toggle through the filters in order
+    auto excludes = [&](const QString &path)
+    {
+        auto exclude = false;
+        for (const auto &filter : filters)
+            if (((exclude && filter.type == PatternType::Include)
+                 || (!exclude && filter.type == PatternType::Exclude))
+                && filter.regex.match(path).hasMatch())
+                exclude = !exclude;
+        return exclude;
+    };
+
+    for (const QString path : {"src/node_modules/x", "build", "build/keep/a.o", "build/keep",
+                               "src/main.o", "src/main.os", "a/b", "a/bc", "x/.cache/y",
+                               "run/12.log", "run/a.log", "xx", "x", "keep/tmp", "tmp/keep",
+                               "src/main.cpp", ""})
+        QCOMPARE(matcher.excludes(path), excludes(path));
+}
+
+void FilesTests::inotify_watcher_move()
+{
+#if defined(Q_OS_LINUX)
+    QTemporaryDir root, elsewhere;
+    QVERIFY(root.isValid() && elsewhere.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkpath("a/b"));
+    QVERIFY(dir.mkdir("a-c"));
+
+    InotifyWatcher w;
+    QSignalSpy spy(&w, &InotifyWatcher::directoryChanged);
+    const QStringList paths{root.path(), dir.filePath("a"), dir.filePath("a/b"), dir.filePath("a-c")};
+    QVERIFY(w.addPaths(paths).isEmpty());
+
+    auto directories = [&]
+    {
+        auto l = w.directories();
+        l.sort();
+        return l;
+    };
+
+    // Moved within, the watches follow
+    QVERIFY(dir.rename("a", "d"));
+    QVERIFY(spy.wait());
+    QCOMPARE(directories(), QStringList({root.path(), dir.filePath("a-c"),
+                                         dir.filePath("d"), dir.filePath("d/b")}));
+
+    // Moved elsewhere, the watches are removed
+    spy.clear();
+    QVERIFY(dir.rename("d", QDir(elsewhere.path()).filePath("d")));
+    QVERIFY(spy.wait());
+    QCOMPARE(directories(), QStringList({root.path(), dir.filePath("a-c")}));
+#else
+    QSKIP("inotify is available on Linux only");
+#endif
+}
+
 void FilesTests::fs_index()
 {
     QLoggingCategory::setFilterRules("*.debug=true");
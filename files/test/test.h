@@ -9,6 +9,15 @@ class FilesTests : public QObject
 private slots:
 
     void fs_index_path();
+    void fs_index_path_serialization();
+    void fs_index_path_mime_resolution();
+    void fs_index_path_checkpoint();
+    void fs_index_path_content();
+    void fs_index_path_sweep();
+    void fs_index_path_list_directories();
+    void fs_index_path_match();
+    void name_filter_matcher();
+    void inotify_watcher_move();
     void fs_index();
 
 };